@@ -16,6 +16,11 @@ struct VariableDeclaration : Base {
 
   bool ignore_initializer;
 
+  //
+  // 初期化式が構造体で、値が外に出ない場合 true
+  // メンバごとに別の変数として確保される
+  bool is_scalar_replaced;
+
   VariableDeclaration(Token const& token);
   ~VariableDeclaration();
 };
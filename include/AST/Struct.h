@@ -19,6 +19,10 @@ struct Struct : Typeable {
 
   std::vector<Member> members;
 
+  //
+  // メモリ配置 (Sema で計算する)
+  StructLayout layout;
+
   Member& append(Token const& token, Type* type)
   {
     return this->members.emplace_back(token, type);
@@ -7,6 +7,7 @@
 #include <functional>
 #include <string>
 #include <vector>
+#include "SmallVector.h"
 #include "TypeInfo.h"
 
 enum BuiltinKind {
@@ -27,7 +28,10 @@ struct BuiltinFunc {
     }
   };
 
-  using ArgumentVector = std::vector<ArgumentObject>;
+  // 引数は InlineArguments 個まで、ヒープに確保せずに渡す
+  static constexpr size_t InlineArguments = 8;
+
+  using ArgumentVector = SmallVector<ArgumentObject, InlineArguments>;
   using Implementation = std::function<Object*(ArgumentVector const&)>;
 
   // BuiltinKind kind;
@@ -43,6 +47,21 @@ struct BuiltinFunc {
 
   Implementation impl;  // 処理
 
+  // self を変更する
+  // self が左辺値であれば、複製せずにそのまま渡される
+  bool modify_self = false;
+
+  // self を変更せず、戻り値にも含めない (要素は複製して返す)
+  // self が変数であれば、複製せずにそのまま渡される
+  bool borrow_self = false;
+
+  // 戻り値の型を self の型から決める (nullptr なら result_type)
+  TypeInfo (*result_type_of)(TypeInfo const& self) = nullptr;
+
+  // 戻り値の型を、代入先の型から決める (let x: T = f() の形でのみ使える)
+  // その型で作成したオブジェクトが、引数の先頭に入れて渡される
+  bool use_expected_type = false;
+
   // BuiltinFunc();
 
   static std::vector<BuiltinFunc> const& get_builtin_list();
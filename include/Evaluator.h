@@ -7,6 +7,7 @@
 #include <map>
 #include "AST/ASTfwd.h"
 #include "GC.h"
+#include "SmallVector.h"
 
 class Evaluator {
   friend struct Object;
@@ -28,8 +29,13 @@ class Evaluator {
     }
   };
 
+  //
+  // 変数の表・関数呼び出しの引数
+  // 関数に入るたびに作られるので、少ないうちはヒープに確保しない
+  using ObjectList = SmallVector<Object*, 8>;
+
   struct var_storage {
-    std::vector<Object*> lvar_list;
+    ObjectList lvar_list;
 
     bool is_skipped = 0;
 
@@ -47,6 +53,26 @@ class Evaluator {
     std::string to_string() const;
   };
 
+  //
+  // 値を直接持つ要素 (構造体のスカラー型メンバなど) への参照
+  //
+  // eval_index_ref でそのような要素を参照したときは、読み出した値の
+  // オブジェクトを object に置いて、その参照を返す
+  // 代入されたときは store_element で owner に書き戻す
+  //
+  // 列指向のベクタでは、要素の index と、メンバの field を持つ
+  // 永続辞書では、index の代わりに key を持つ
+  struct ElementProxy {
+    static constexpr size_t NoField = (size_t)-1;
+
+    Object* object = nullptr;
+
+    Object* owner = nullptr;
+    size_t index = 0;
+    size_t field = NoField;
+    Object* key = nullptr;
+  };
+
   struct LoopStack {
     var_storage& vs;
     bool is_breaked;
@@ -65,6 +91,12 @@ public:
   ~Evaluator();
 
   Object* evaluate(AST::Base* ast);
+
+  //
+  // 変数・要素に格納する値を評価する
+  // 即値 (リテラル) は構文木ごとに共有されているので、複製する
+  Object* eval_for_store(AST::Base* ast);
+
   Object* eval_callfunc(AST::CallFunc* ast);
 
   Object* eval_stmt(AST::Base* ast);
@@ -73,7 +105,8 @@ public:
 
   //
   // index-ref
-  Object*& eval_index_ref(Object*& obj, AST::IndexRef* ast);
+  Object*& eval_index_ref(Object*& obj, AST::IndexRef* ast,
+                          bool is_lvalue = true);
   Object*& eval_member_access(Object*& obj, AST::IndexRef* ast);
 
   //
@@ -138,6 +171,15 @@ private:
 
   Object*& get_var(AST::Variable* ast);
 
+  //
+  // 要素への参照を ElementProxy で作成する
+  Object*& set_proxy(Object* owner, size_t index, Object* value,
+                     size_t field = ElementProxy::NoField);
+
+  //
+  // ElementProxy を通して要素に値を書き戻す
+  void store_element(ElementProxy const& proxy, Object* value);
+
   static void gc_stop();
   static void gc_resume();
 
@@ -159,5 +201,7 @@ private:
   std::list<LoopStack> loop_stack;
   std::map<Object*, AST::Base*> return_binds;
 
+  ElementProxy proxy;
+
   static std::map<Object*, bool> allocated_objects;
 };
@@ -0,0 +1,151 @@
+// ---------------------------------------------
+//  Heap accounting
+// ---------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "TypeInfo.h"
+#include "AST/ASTfwd.h"
+
+//
+// オブジェクトの確保量を TypeKind ごとに数える
+//
+// Object::operator new で確保した領域の前にヘッダを置いておき、
+// Object のコンストラクタ・デストラクタで型ごとの使用量に加減算する
+// オブジェクトが持つ領域 (要素の配列や文字列など) は HeapAllocator で
+// 確保して、同じ型の使用量に数える
+// 上限を超えたときは実行を中止する
+//
+// ヘッダは生存しているオブジェクトのリストも兼ねていて、
+// dump でスナップショットを書き出せる
+class Heap {
+public:
+  struct Usage {
+    size_t bytes = 0;
+    size_t count = 0;
+  };
+
+  //
+  // 確保・解放
+  static void* allocate(size_t size);
+  static void deallocate(void* p);
+
+  //
+  // allocate で確保した p のサイズを kind の使用量に加算・減算する
+  static void charge(TypeKind kind, void const* p);
+  static void uncharge(TypeKind kind, void const* p);
+
+  //
+  // オブジェクトが持つ領域 size バイトを kind の使用量に加算・減算する
+  // (オブジェクトの数には含めない)
+  static void charge_buffer(TypeKind kind, size_t size);
+  static void uncharge_buffer(TypeKind kind, size_t size);
+
+  static Usage const& get_usage(TypeKind kind);
+
+  static size_t get_current();
+  static size_t get_peak();
+  static size_t get_count();
+
+  //
+  // 上限 (バイト)
+  // 0 なら無制限
+  static void set_limit(size_t limit);
+  static size_t get_limit();
+
+  //
+  // 確保した位置として記録する構文木
+  // Evaluator::evaluate で設定される
+  static void set_site(AST::Base const* ast)
+  {
+    _site = ast;
+  }
+
+  //
+  // 生存しているオブジェクトをすべて path に書き出す
+  // (参照カウントが 0 の、解放待ちのものは除く)
+  //
+  // フォーマット (リトルエンディアン)
+  //   "METROHP2"
+  //   u32 型の数, { u8 TypeKind, u32 長さ, 型の名前 } ...
+  //   u32 サイトの数, { u32 長さ, 文字列 "path:line" } ...
+  //   u64 オブジェクトの数,
+  //   { u64 アドレス, u8 TypeKind, u64 サイズ, u64 参照カウント,
+  //     u32 サイト (なければ 0xFFFFFFFF), u32 参照先の数, u64 参照先... } ...
+  //
+  // 読み込みは srctools/metro-heap.py
+  static bool dump(std::string const& path);
+
+  //
+  // 実行の終了時に dump する場所
+  static void set_dump_path(std::string const& path);
+  static std::string const& get_dump_path();
+
+  //
+  // 場所が指定されていれば dump する (一度だけ)
+  // 一番外側のスコープを抜ける前、exit()、上限を超えて中止するときに呼ばれる
+  static void dump_on_exit();
+
+private:
+  static inline AST::Base const* _site = nullptr;
+
+  //
+  // 上限を超えた
+  //  --> dump してから実行を中止する
+  static void limit_exceeded();
+};
+
+//
+// 確保量を Heap で数えるアロケータ
+//
+// オブジェクトが持つ配列や共有する節に使い、Kind の使用量として数える
+template <class T, TypeKind Kind>
+struct HeapAllocator {
+  using value_type = T;
+
+  template <class U>
+  struct rebind {
+    using other = HeapAllocator<U, Kind>;
+  };
+
+  HeapAllocator() = default;
+
+  template <class U>
+  HeapAllocator(HeapAllocator<U, Kind> const&) noexcept
+  {
+  }
+
+  T* allocate(size_t n)
+  {
+    Heap::charge_buffer(Kind, n * sizeof(T));
+    return std::allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, size_t n) noexcept
+  {
+    std::allocator<T>().deallocate(p, n);
+    Heap::uncharge_buffer(Kind, n * sizeof(T));
+  }
+
+  template <class U>
+  bool operator==(HeapAllocator<U, Kind> const&) const noexcept
+  {
+    return true;
+  }
+};
+
+template <class T, TypeKind Kind>
+using HeapVector = std::vector<T, HeapAllocator<T, Kind>>;
+
+//
+// 制御ブロックとあわせて、Kind の使用量として確保する
+template <class T, TypeKind Kind, class... Args>
+std::shared_ptr<T> make_heap_shared(Args&&... args)
+{
+  return std::allocate_shared<T>(HeapAllocator<T, Kind>(),
+                                 std::forward<Args>(args)...);
+}
@@ -0,0 +1,114 @@
+// ---------------------------------------------
+//  Kernel
+//
+//  数値の配列・文字列に対する処理
+//  AVX2 が使える CPU では、それを使う (実行時に判定)
+// ---------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "Object/mt_string.h"
+
+namespace Kernel {
+
+int64_t sum(int64_t const* p, size_t n);
+float sum(float const* p, size_t n);
+
+//
+// n は 1 以上であること
+int64_t min(int64_t const* p, size_t n);
+float min(float const* p, size_t n);
+int64_t max(int64_t const* p, size_t n);
+float max(float const* p, size_t n);
+
+int64_t dot(int64_t const* a, int64_t const* b, size_t n);
+float dot(float const* a, float const* b, size_t n);
+
+//
+// p[i] *= k
+void scale(int64_t* p, size_t n, int64_t k);
+void scale(float* p, size_t n, float k);
+
+//
+// dest[i] += src[i]
+void add(int64_t* dest, int64_t const* src, size_t n);
+void add(float* dest, float const* src, size_t n);
+
+//
+// dest[i] -= src[i], dest[i] *= src[i]
+void sub(int64_t* dest, int64_t const* src, size_t n);
+void sub(float* dest, float const* src, size_t n);
+void mul(int64_t* dest, int64_t const* src, size_t n);
+void mul(float* dest, float const* src, size_t n);
+
+//
+// 行列の積 c = a * b
+// a は n 行 k 列, b は k 行 m 列, c は n 行 m 列 (いずれも行優先で連続)
+// キャッシュに収まる大きさのブロックごとに計算し、
+// 大きな行列は行を分けて複数のスレッドで計算する
+void matmul(int64_t const* a, int64_t const* b, int64_t* c, size_t n,
+            size_t k, size_t m);
+void matmul(float const* a, float const* b, float* c, size_t n, size_t k,
+            size_t m);
+
+void fill(int64_t* p, size_t n, int64_t value);
+void fill(float* p, size_t n, float value);
+
+size_t count(int64_t const* p, size_t n, int64_t value);
+size_t count(float const* p, size_t n, float value);
+
+//
+// 見つからなければ -1
+int64_t index_of(int64_t const* p, size_t n, int64_t value);
+int64_t index_of(float const* p, size_t n, float value);
+
+//
+// ビット列 (64 ビットの語 n 個)
+//
+// 立っているビットの数
+// POPCNT 命令が使える CPU では、それを使う (実行時に判定)
+size_t popcount(uint64_t const* p, size_t n);
+
+//
+// dest[i] &= src[i], dest[i] |= src[i], dest[i] ^= src[i]
+void bit_and(uint64_t* dest, uint64_t const* src, size_t n);
+void bit_or(uint64_t* dest, uint64_t const* src, size_t n);
+void bit_xor(uint64_t* dest, uint64_t const* src, size_t n);
+
+//
+// p[i] = ~p[i]
+void bit_not(uint64_t* p, size_t n);
+
+//
+// 文字列 hay (長さ n) の中から needle (長さ m) を探す
+// 見つからなければ -1
+int64_t find(metro_char_t const* hay, size_t n, metro_char_t const* needle,
+             size_t m);
+
+//
+// UTF-8 (n バイト) を UTF-16 に変換して dest に書き込む
+// dest には n 文字分の領域が必要
+// 不正なバイト列は、最長の不正な部分列 (maximal subpart) ごとに
+// U+FFFD に置き換える
+// 戻り値: 書き込んだ文字数
+size_t utf8_to_utf16(char const* src, size_t n, metro_char_t* dest);
+
+//
+// UTF-16 (n 文字) を UTF-8 に変換して dest に書き込む
+// dest には n * 3 バイトの領域が必要
+// 対になっていないサロゲートは U+FFFD に置き換える
+// 戻り値: 書き込んだバイト数
+size_t utf16_to_utf8(metro_char_t const* src, size_t n, char* dest);
+
+//
+// UTF-8 に変換したときのバイト数
+size_t utf8_length(metro_char_t const* p, size_t n);
+
+//
+// 対になっていないサロゲートを含まないか
+// (UTF-8 にそのまま変換できるか)
+bool is_well_formed(metro_char_t const* p, size_t n);
+
+}  // namespace Kernel
@@ -3,6 +3,9 @@
 // ---------------------------------------------
 #pragma once
 
+#include <memory>
+#include "Heap.h"
+#include "SmallVector.h"
 #include "TypeInfo.h"
 #include "AST/ASTfwd.h"
 #include "mt_string.h"
@@ -30,6 +33,32 @@ struct Object {
 
   bool equals(Object* object) const;
 
+  //
+  // ハッシュ値
+  // equals が true になるオブジェクトどうしは同じ値を返す
+  size_t hash() const;
+
+  //
+  // 大小を比較する (負: this < x, 0: 等しい, 正: this > x)
+  // 数値, char, bool, string のみ (is_comparable)
+  // 何も変更しないので、複数のスレッドから呼んでよい
+  // (ただし string は平坦化しておくこと)
+  int compare(Object* x) const;
+
+  static bool is_comparable(TypeKind kind);
+
+  //
+  // 値を直接持つ領域との変換
+  // kind は StructLayout::get_inline_size が 0 でない型であること
+  static Object* from_raw(TypeKind kind, void const* p);
+  static void to_raw(TypeKind kind, void* p, Object const* obj);
+  static std::string raw_to_string(TypeKind kind, void const* p);
+
+  //
+  // 確保量は Heap で数える
+  static void* operator new(size_t size);
+  static void operator delete(void* p);
+
   virtual ~Object();
 
 protected:
@@ -43,32 +72,70 @@ T*& add_refcount(T*& obj)
   return obj;
 }
 
+//
+// ユーザー定義型 (構造体)
+//
+// メンバは StructLayout に従って、オブジェクトの直後に確保した
+// 領域に置かれる (スカラー型は値、それ以外はポインタ)
 struct ObjUserType : Object {
-  std::vector<Object*> members;
+  StructLayout const* layout;
 
   std::string to_string() const;
   ObjUserType* clone() const;
 
-  Object*& add_member(Object* obj)
+  bool equals(ObjUserType* x) const;
+
+  size_t member_count() const
   {
-    auto& ret = this->members.emplace_back(obj);
+    return this->layout ? this->layout->fields.size() : 0;
+  }
+
+  bool is_inline(size_t index) const
+  {
+    return this->layout->fields[index].is_inline;
+  }
+
+  //
+  // メンバを取得する
+  // 値を直接持つメンバであれば、新しいオブジェクトを作成する
+  Object* get_member(size_t index) const;
 
-    ret->ref_count++;
+  //
+  // メンバを設定する
+  void set_member(size_t index, Object* obj);
 
-    return ret;
+  //
+  // ポインタで持つメンバへの参照
+  Object*& ref_member(size_t index)
+  {
+    return *(Object**)this->field_ptr(index);
+  }
+
+  //
+  // 構造体のオブジェクトを作成する
+  // スカラー型のメンバは 0, それ以外は nullptr で初期化される
+  static ObjUserType* create(AST::Typeable* ast);
+
+  //
+  // メンバの領域へのポインタ
+  unsigned char* field_ptr(size_t index) const
+  {
+    return this->data() + this->layout->fields[index].offset;
   }
 
-  explicit ObjUserType(AST::Typeable* ast)
-    : Object(TYPE_UserDef)
+  ~ObjUserType();
+
+private:
+  explicit ObjUserType(AST::Typeable* ast, StructLayout const* layout)
+    : Object(TYPE_UserDef),
+      layout(layout)
   {
     this->type.userdef_type = ast;
   }
 
-  ~ObjUserType()
+  unsigned char* data() const
   {
-    for (auto&& m : this->members) {
-      m->ref_count--;
-    }
+    return (unsigned char*)this + sizeof(ObjUserType);
   }
 };
 
@@ -234,84 +301,278 @@ struct ObjChar : Object {
   }
 };
 
+//
+// 文字列の連結の木 (rope)
+//
+// 葉は文字列、節は左右の連結を表す
+// 複数の ObjString から共有されるので、作成した後は変更しない
+struct RopeNode {
+  std::shared_ptr<RopeNode> left;
+  std::shared_ptr<RopeNode> right;
+
+  metro_string_t leaf;  // 葉のとき
+  size_t length;
+
+  // 部分文字列のとき、left (葉) の中の位置
+  size_t offset = 0;
+
+  bool is_leaf() const
+  {
+    return !this->left;
+  }
+
+  //
+  // 部分文字列 (left のみを持つ)
+  bool is_slice() const
+  {
+    return this->left && !this->right;
+  }
+
+  //
+  // 連結した文字列を out の後ろに追加する
+  void flatten_to(metro_string_t& out) const;
+
+  static std::shared_ptr<RopeNode> make_leaf(metro_string_t&& str);
+
+  static std::shared_ptr<RopeNode> make_concat(std::shared_ptr<RopeNode> left,
+                                               std::shared_ptr<RopeNode> right);
+
+  //
+  // base (葉または部分文字列) の offset から length 文字を参照する
+  static std::shared_ptr<RopeNode> make_slice(
+    std::shared_ptr<RopeNode> const& base, size_t offset, size_t length);
+
+  // 木が深くなってもスタックを使い切らないように、ループで解放する
+  ~RopeNode();
+};
+
+//
+// 登録 (intern) された文字列
+//
+// 同じ内容の文字列は一つしか登録されないので、ポインタで比較できる
+// 登録したものは解放しない
+struct InternedString {
+  metro_string_t str;
+  size_t hash;
+
+  //
+  // str を登録する
+  // すでに登録されていればそれを返す
+  static InternedString const* get(std::u16string_view str);
+};
+
+//
+// 文字列
+//
+// 文字は連続した領域 (metro_string_t) に持つ
+// 短い文字列はオブジェクト内に収まる (small string optimization)
+// ObjChar は添字で参照したときにのみ作成する
+//
+// 長い文字列の複製と連結は rope を共有して O(1) で行い、
+// 添字・比較・表示などで中身が必要になったときに平坦化する
+// 部分文字列 (s[a..b]) は元の文字列の葉を共有し、位置と長さだけを持つ
+// 比較・検索・添字は葉と部分文字列をそのまま参照 (view) し、
+// 変更するときにだけ平坦化する
+//
+// リテラルと intern() した文字列は登録され、ポインタで比較される
+// 内容を変更すると登録は外れる
+// (辞書・集合のキーは登録せず、要素ごとに持つハッシュ値で探す)
 struct ObjString : Object {
-  std::vector<ObjChar*> characters;
+  //
+  // これより短い文字列は、連結するときにそのままコピーする
+  static constexpr size_t RopeThreshold = 32;
+
+  // rope が nullptr のときのみ有効
+  // (rope が葉であれば、その中身が文字列)
+  mutable metro_string_t value;
+  mutable std::shared_ptr<RopeNode> rope;
+
+  // 登録されていれば、その文字列
+  InternedString const* interned = nullptr;
 
   std::string to_string() const;
   ObjString* clone() const;
 
   bool equals(ObjString* x) const
   {
-    if (this->characters.size() == x->characters.size()) {
-      for (auto it = this->characters.begin(); auto&& c : x->characters)
-        if (!(*it)->equals(c))
-          return false;
-    }
+    if (this->interned && x->interned)
+      return this->interned == x->interned;
 
-    return false;
+    return this->length() == x->length() && this->view() == x->view();
   }
 
-  ObjChar*& append(ObjChar* c)
+  size_t hash() const
   {
-    return add_refcount(this->characters.emplace_back(c));
+    if (this->interned)
+      return this->interned->hash;
+
+    return std::hash<std::u16string_view>{}(this->view());
   }
 
-  ObjChar*& append(metro_char_t c)
+  //
+  // 登録する
+  ObjString* intern()
   {
-    return add_refcount(this->characters.emplace_back(new ObjChar(c)));
+    if (!this->interned)
+      this->interned = InternedString::get(this->view());
+
+    return this;
   }
 
-  // copy
-  ObjString& append(ObjString* str)
+  void append(metro_char_t c)
   {
-    for (auto&& c : str->characters) {
-      this->append(c->clone());
-    }
-
-    return *this;
+    this->flatten();
+    this->value += c;
+    this->interned = nullptr;
   }
 
+  // copy
+  ObjString& append(ObjString* str);
+
   ObjString& append(std::wstring const& str)
   {
+    this->flatten();
+    this->interned = nullptr;
+    this->value.reserve(this->value.length() + str.length());
+
     for (auto&& c : str)
-      this->append(c);
+      this->value += (metro_char_t)c;
 
     return *this;
   }
 
-  metro_string_t get_string() const
+  //
+  // 内容を参照する
+  // 葉と部分文字列はそのまま参照し、連結のときのみ平坦化する
+  // 内容を変更すると無効になる
+  std::u16string_view view() const
   {
-    metro_string_t ret;
+    if (this->rope) {
+      if (this->rope->is_leaf())
+        return this->rope->leaf;
+
+      if (this->rope->is_slice()) {
+        return std::u16string_view(this->rope->left->leaf)
+          .substr(this->rope->offset, this->rope->length);
+      }
 
-    for (auto&& c : this->characters)
-      ret += c->value;
+      this->flatten_rope();
+    }
 
-    return ret;
+    return this->value;
   }
 
+  //
+  // 内容を連続した文字列として取得する (部分文字列も平坦化する)
+  metro_string_t const& get_string() const
+  {
+    // 葉はそのまま使える
+    if (this->rope && this->rope->is_leaf())
+      return this->rope->leaf;
+
+    this->flatten();
+    return this->value;
+  }
+
+  //
+  // 部分文字列 [begin, end) を作成する
+  // コピーせずに元の文字列を参照する
+  ObjString* slice(size_t begin, size_t end) const;
+
   size_t length() const
   {
-    return this->characters.size();
+    return this->rope ? this->rope->length : this->value.length();
+  }
+
+  //
+  // index 番目の文字のオブジェクトを作成する
+  ObjChar* get_char(size_t index) const
+  {
+    return new ObjChar(this->view()[index]);
+  }
+
+  void set_char(size_t index, ObjChar const* c)
+  {
+    this->flatten();
+    this->value[index] = c->value;
+    this->interned = nullptr;
+  }
+
+  //
+  // rope を連結して value に置き換える
+  // 内容を変更する前に呼ぶこと
+  void flatten() const
+  {
+    if (this->rope)
+      this->flatten_rope();
   }
 
   static ObjString* from_u8_string(std::string const& str)
   {
-    return new ObjString(Utils::String::to_wstr(str));
+    return new ObjString(metro_string_t::from_utf8(str));
   }
 
   ObjString(std::wstring const& value = L"")
     : Object(TYPE_String)
   {
-    for (auto&& c : value)
-      this->append(c);
+    this->append(value);
+  }
+
+  ObjString(metro_string_t&& value)
+    : Object(TYPE_String),
+      value(std::move(value))
+  {
   }
 
-  ObjString(std::vector<ObjChar*> const& vec)
+  ObjString(metro_string_t const& value)
     : Object(TYPE_String),
-      characters(vec)
+      value(value)
+  {
+  }
+
+  //
+  // 内容を out の後ろに追加する (平坦化しない)
+  void append_to(metro_string_t& out) const
+  {
+    if (this->rope)
+      this->rope->flatten_to(out);
+    else
+      out += this->value;
+  }
+
+private:
+  void flatten_rope() const;
+
+  //
+  // 文字列を rope の節として取得する
+  // 平坦であれば、value を葉に移して共有できるようにする
+  std::shared_ptr<RopeNode> const& as_rope() const;
+};
+
+//
+// 文字列を組み立てるためのバッファ
+//
+// 追加は buffer の末尾に書き込むだけなので、償却 O(1)
+// build() は buffer をそのまま文字列に渡し、自身は空になる
+struct ObjStringBuilder : Object {
+  metro_string_t buffer;
+
+  std::string to_string() const;
+  ObjStringBuilder* clone() const;
+
+  bool equals(ObjStringBuilder* x) const
+  {
+    return this->buffer == x->buffer;
+  }
+
+  ObjString* build()
+  {
+    return new ObjString(std::move(this->buffer));
+  }
+
+  ObjStringBuilder()
+    : Object(TYPE_StringBuilder)
   {
-    for (auto&& c : this->characters)
-      c->ref_count--;
   }
 };
 
@@ -335,102 +596,883 @@ struct ObjRange : Object {
   }
 };
 
+//
+// 辞書
+//
+// 要素は追加した順に items に持ち、キーの検索には
+// オープンアドレス法 (線形探索) のハッシュ表 slots を使う
+// 削除した要素は key を nullptr にしておき、増えてきたら詰める
+//
+// キーがすべて小さな 0 以上の int である間は、slots の代わりに
+// キーを添字とする表 (dense) を使う
 struct ObjDict : Object {
   struct Item {
     Object* key;
     Object* value;
+    size_t hash;
 
-    Item(Object* k, Object* v)
+    Item(Object* k, Object* v, size_t hash)
       : key(k),
-        value(v)
+        value(v),
+        hash(hash)
     {
       this->key->ref_count++;
       this->value->ref_count++;
     }
 
+    Item(Item&& item) noexcept
+      : key(item.key),
+        value(item.value),
+        hash(item.hash)
+    {
+      item.key = nullptr;
+      item.value = nullptr;
+    }
+
+    Item& operator=(Item&& item) noexcept
+    {
+      std::swap(this->key, item.key);
+      std::swap(this->value, item.value);
+      std::swap(this->hash, item.hash);
+
+      return *this;
+    }
+
+    Item(Item const&) = delete;
+    Item& operator=(Item const&) = delete;
+
+    bool is_removed() const
+    {
+      return this->key == nullptr;
+    }
+
+    //
+    // 参照を外して、削除済みにする
+    void release()
+    {
+      if (this->key)
+        this->key->ref_count--;
+
+      if (this->value)
+        this->value->ref_count--;
+
+      this->key = nullptr;
+      this->value = nullptr;
+    }
+
     ~Item()
     {
-      this->key->ref_count--;
-      this->value->ref_count--;
+      this->release();
     }
   };
 
-  std::vector<Item> items;
+  HeapVector<Item, TYPE_Dict> items;
 
   std::string to_string() const;
   ObjDict* clone() const;
 
-  bool equals(ObjDict* x) const
+  bool equals(ObjDict* x) const;
+
+  size_t size() const
+  {
+    return this->count;
+  }
+
+  //
+  // キーを探す
+  // 見つからなければ nullptr
+  Item* find(Object* key);
+
+  //
+  // 追加する
+  // すでにあるキーなら値を置き換える
+  Item& append(Object* key, Object* value);
+
+  //
+  // 削除する
+  // 見つからなければ false
+  bool remove(Object* key);
+
+  //
+  // n 個の要素を追加しても、作り直さないようにする
+  void reserve(size_t n);
+
+  //
+  // x の要素をすべて追加する (同じキーは x の値で置き換える)
+  void extend(ObjDict const* x);
+
+  //
+  // 削除済みの要素を詰めて、余分な領域を解放する
+  void shrink_to_fit();
+
+  ObjDict()
+    : Object(TYPE_Dict),
+      count(0),
+      is_dense(true)
+  {
+  }
+
+  ~ObjDict()
   {
-    if (this->items.size() != x->items.size())
-      return false;
+  }
+
+private:
+  //
+  // slots の値
+  //  0 = 空き, 1 = 削除済み, それ以外 = items の添字 + 2
+  static constexpr uint32_t SlotEmpty = 0;
+  static constexpr uint32_t SlotRemoved = 1;
+
+  HeapVector<uint32_t, TYPE_Dict> slots;
+  size_t count;  // 削除されていない要素の数
+
+  //
+  // キーが見つかった slots の位置、または追加する位置
+  size_t find_slot(Object* key, size_t hash, bool& found) const;
+
+  //
+  // 削除した要素を詰めて、slots を作り直す
+  void rehash(size_t capacity);
+
+  //
+  // 整数のキーの直接の表
+  //
+  // dense[key] = items の添字 + 1 (0 = なし)
+  // ハッシュ値の計算もキーの比較も要らないので、数え上げなどが速い
+  // 表の大きさが DenseMinSize と 要素数 * DenseMaxRatio の大きい方を
+  // 超えるキーや、int 以外のキーが追加されたら、ハッシュ表に切り替える
+  static constexpr size_t DenseMinSize = 64;
+  static constexpr size_t DenseMaxRatio = 4;
+
+  HeapVector<uint32_t, TYPE_Dict> dense;
+  bool is_dense;
+
+  //
+  // key を追加しても dense のままでいられるか
+  bool fits_dense(Object* key) const;
+
+  //
+  // ハッシュ表に切り替える (戻らない)
+  void leave_dense();
+
+  //
+  // 削除した要素を詰めて、dense を作り直す
+  void rebuild_dense();
+};
 
-    for (auto xx = x->items.begin(); auto&& self : this->items) {
-      if (!self.key->equals(xx->key) || !self.value->equals(xx->value))
-        return false;
-      xx++;
+//
+// 集合
+//
+// ObjDict と同じく、要素は追加した順に items に持ち、
+// オープンアドレス法のハッシュ表 slots で探す
+struct ObjSet : Object {
+  struct Item {
+    Object* key;
+    size_t hash;
+
+    Item(Object* k, size_t hash)
+      : key(k),
+        hash(hash)
+    {
+      this->key->ref_count++;
     }
 
-    return true;
+    Item(Item&& item) noexcept
+      : key(item.key),
+        hash(item.hash)
+    {
+      item.key = nullptr;
+    }
+
+    Item& operator=(Item&& item) noexcept
+    {
+      std::swap(this->key, item.key);
+      std::swap(this->hash, item.hash);
+
+      return *this;
+    }
+
+    Item(Item const&) = delete;
+    Item& operator=(Item const&) = delete;
+
+    bool is_removed() const
+    {
+      return this->key == nullptr;
+    }
+
+    void release()
+    {
+      if (this->key)
+        this->key->ref_count--;
+
+      this->key = nullptr;
+    }
+
+    ~Item()
+    {
+      this->release();
+    }
+  };
+
+  HeapVector<Item, TYPE_Set> items;
+
+  std::string to_string() const;
+  ObjSet* clone() const;
+
+  bool equals(ObjSet* x) const;
+
+  size_t size() const
+  {
+    return this->count;
   }
 
-  Item& append(Object* key, Object* value)
+  bool contains(Object* key) const;
+
+  //
+  // 追加する
+  // すでにあれば何もせずに false
+  bool insert(Object* key);
+
+  //
+  // 削除する
+  // 見つからなければ false
+  bool remove(Object* key);
+
+  explicit ObjSet(TypeInfo const& type)
+    : Object(type),
+      count(0)
   {
-    return this->items.emplace_back(key, value);
   }
 
-  ObjDict()
-    : Object(TYPE_Dict)
+private:
+  static constexpr uint32_t SlotRemoved = 1;
+
+  HeapVector<uint32_t, TYPE_Set> slots;
+  size_t count;  // 削除されていない要素の数
+};
+
+//
+// 両端キュー
+//
+// 大きさが 2 のべき乗のリングバッファに要素を持つ
+// 両端への追加・削除と添字によるアクセスは O(1)
+struct ObjDeque : Object {
+  std::string to_string() const;
+  ObjDeque* clone() const;
+
+  bool equals(ObjDeque* x) const;
+
+  size_t size() const
   {
+    return this->count;
   }
 
-  ObjDict(std::vector<Item>&& _items)
-    : Object(TYPE_Dict),
-      items(std::move(_items))
+  //
+  // 先頭から index 番目の要素
+  Object*& at(size_t index)
   {
+    return this->buffer[(this->head + index) & (this->buffer.size() - 1)];
   }
 
-  ~ObjDict()
+  Object* at(size_t index) const
+  {
+    return this->buffer[(this->head + index) & (this->buffer.size() - 1)];
+  }
+
+  void push_back(Object* obj);
+  void push_front(Object* obj);
+
+  //
+  // 取り除いた要素を返す
+  // 空でないこと
+  Object* pop_back();
+  Object* pop_front();
+
+  size_t capacity() const
+  {
+    return this->buffer.size();
+  }
+
+  explicit ObjDeque(TypeInfo const& type)
+    : Object(type),
+      head(0),
+      count(0)
+  {
+  }
+
+  ~ObjDeque()
+  {
+    for (size_t i = 0; i < this->count; i++)
+      this->at(i)->ref_count--;
+  }
+
+private:
+  HeapVector<Object*, TYPE_Deque> buffer;
+  size_t head;  // 先頭の要素の位置
+  size_t count;
+
+  //
+  // 満杯なら、大きさを倍にして先頭から詰め直す
+  void grow();
+};
+
+struct ObjVector;
+
+//
+// 優先度付きキュー (最小ヒープ)
+//
+// 要素は二分ヒープの順に配列に持ち、pop / peek は最も小さいものを返す
+// 追加と削除は O(log n), 最小値の参照は O(1)
+//
+// 要素の型が int, usize, float, bool, char の場合は、値の配列
+// (values) に持つ (is_scalar)
+// オブジェクトは要素を取り出したときにのみ作成する
+//
+// 要素の型は比較できること (Object::is_comparable)
+struct ObjHeap : Object {
+  HeapVector<Object*, TYPE_Heap> elements;
+  HeapVector<unsigned char, TYPE_Heap> values;
+
+  // 要素がスカラー型 (values が値の配列)
+  bool is_scalar;
+
+  //
+  // 小さい順に表示する
+  std::string to_string() const;
+  ObjHeap* clone() const;
+
+  //
+  // 要素の並びによらず、同じ値を同じ数だけ持っていれば等しい
+  bool equals(ObjHeap* x) const;
+
+  size_t size() const
+  {
+    return this->is_scalar ? this->values.size() / this->elem_size
+                           : this->elements.size();
+  }
+
+  void push(Object* obj);
+
+  //
+  // 最も小さい要素を取り除いて返す
+  // 空でないこと
+  Object* pop();
+
+  //
+  // 最も小さい要素の複製
+  // 空でないこと
+  Object* peek() const;
+
+  //
+  // vec の要素をすべて追加して、まとめてヒープを作り直す (O(n))
+  void heapify(ObjVector const* vec);
+
+  size_t capacity_bytes() const
+  {
+    return this->elements.capacity() * sizeof(Object*) +
+           this->values.capacity();
+  }
+
+  explicit ObjHeap(TypeInfo const& type);
+
+  ~ObjHeap()
+  {
+    for (auto&& elem : this->elements) {
+      elem->ref_count--;
+    }
+  }
+
+private:
+  TypeKind elem_kind;
+  size_t elem_size;  // is_scalar のとき、値ひとつのバイト数
+};
+
+//
+// ビット列
+//
+// 64 ビットの語の配列に持ち、数え上げや論理演算は語ごとに行う
+// set で範囲の外を指定すると、そこまで大きくなる
+// length より後ろのビットは常に 0 にしておくこと
+struct ObjBitset : Object {
+  HeapVector<uint64_t, TYPE_Bitset> words;
+  size_t length;  // ビット数
+
+  std::string to_string() const;
+  ObjBitset* clone() const;
+
+  bool equals(ObjBitset* x) const
+  {
+    return this->length == x->length && this->words == x->words;
+  }
+
+  size_t size() const
+  {
+    return this->length;
+  }
+
+  bool test(size_t index) const
+  {
+    return index < this->length &&
+           (this->words[index / 64] >> (index % 64)) & 1;
+  }
+
+  void set(size_t index)
+  {
+    if (index >= this->length)
+      this->resize(index + 1);
+
+    this->words[index / 64] |= (uint64_t)1 << (index % 64);
+  }
+
+  void clear(size_t index)
+  {
+    if (index < this->length)
+      this->words[index / 64] &= ~((uint64_t)1 << (index % 64));
+  }
+
+  //
+  // 立っているビットの数
+  size_t count() const;
+
+  //
+  // index 以降で、最初に立っているビットの位置
+  // なければ length
+  size_t find_next(size_t index) const;
+
+  //
+  // ビット数を n にする
+  // 増えた部分は 0, 減った部分は捨てる
+  void resize(size_t n);
+
+  //
+  // this op= x
+  // ビット数は大きい方に合わせる
+  void bit_and(ObjBitset const* x);
+  void bit_or(ObjBitset const* x);
+  void bit_xor(ObjBitset const* x);
+
+  //
+  // length までのビットを反転する
+  void flip();
+
+  ObjBitset()
+    : Object(TYPE_Bitset),
+      length(0)
   {
   }
 };
 
+//
+// n 次元配列 (ndarray<int>, ndarray<float>)
+//
+// 要素は値の配列 (buffer) に持ち、各軸の大きさ (shape) と
+// 間隔 (strides) で位置を決める
+// 転置などは buffer を共有して shape と strides だけを変えた
+// ビューを作るので O(1)
+//
+// buffer は複製やビューの間で共有され、内容を変更するときに
+// 初めて連続した自分専用の領域にコピーする (copy on write)
+struct ObjNdArray : Object {
+  using Buffer = HeapVector<unsigned char, TYPE_NdArray>;
+
+  std::shared_ptr<Buffer> buffer;
+  size_t offset;  // 先頭の要素の位置 (要素単位)
+
+  std::vector<size_t> shape;
+  std::vector<size_t> strides;  // 要素単位
+
+  std::string to_string() const;
+  ObjNdArray* clone() const;
+
+  bool equals(ObjNdArray* x) const;
+
+  TypeKind elem_kind() const
+  {
+    return this->type.type_params[0].kind;
+  }
+
+  size_t ndim() const
+  {
+    return this->shape.size();
+  }
+
+  //
+  // 要素数
+  size_t size() const;
+
+  //
+  // 行優先で隙間なく並んでいるか
+  bool is_contiguous() const;
+
+  //
+  // 行優先で linear 番目の要素の、buffer の中の位置
+  size_t position(size_t linear) const;
+
+  //
+  // 行優先で linear 番目の要素を取得・設定する
+  Object* get_element(size_t linear) const;
+  void set_element(size_t linear, Object* obj);
+
+  //
+  // 値の配列の先頭
+  // is_contiguous であること
+  template <class T>
+  T const* data() const
+  {
+    return (T const*)this->buffer->data() + this->offset;
+  }
+
+  //
+  // 変更する場合はこちら
+  // 共有している、または連続していなければ、コピーしてから返す
+  template <class T>
+  T* mutable_data()
+  {
+    this->make_unique();
+    return (T*)this->buffer->data();
+  }
+
+  //
+  // 連続していなければ、連続した領域にコピーする (共有はそのまま)
+  void make_contiguous();
+
+  //
+  // 軸の順序を逆にしたビュー
+  ObjNdArray* transpose() const;
+
+  //
+  // 形を変えたもの
+  // 連続していれば buffer を共有する
+  // 要素数が同じであること
+  ObjNdArray* reshape(std::vector<size_t> const& new_shape) const;
+
+  //
+  // this op= x
+  // 要素ごとに計算する (x は同じ形の n 次元配列、または要素の型の値)
+  // 整数の割り算では、0 で割らないことを確かめておくこと
+  void combine(AST::ExprKind kind, Object const* x);
+
+  //
+  // 0 で初期化した配列を作成する
+  static ObjNdArray* create(TypeKind kind, std::vector<size_t> const& shape);
+
+  //
+  // 各軸の大きさから、行優先の間隔
+  static std::vector<size_t> row_major_strides(
+    std::vector<size_t> const& shape);
+
+  explicit ObjNdArray(TypeInfo const& type)
+    : Object(type),
+      buffer(make_heap_shared<Buffer, TYPE_NdArray>()),
+      offset(0)
+  {
+  }
+
+private:
+  size_t elem_size() const
+  {
+    return StructLayout::get_inline_size(this->elem_kind());
+  }
+
+  //
+  // 共有している、または連続していなければ、
+  // 連続した自分専用の領域にコピーする
+  void make_unique();
+};
+
+//
+// 永続ベクタの節
+//
+// 32 分木で、葉は values、枝は children を使う
+// 複数の ObjPVector (のバージョン) から共有されるので、
+// use_count が 1 でない節は変更せずに、コピーしてから変更すること
+struct PVecNode {
+  static constexpr size_t Bits = 5;
+  static constexpr size_t Width = 1 << Bits;
+  static constexpr size_t Mask = Width - 1;
+
+  std::shared_ptr<PVecNode> children[Width];
+  Object* values[Width]{};
+
+  PVecNode() = default;
+  PVecNode(PVecNode const& node);
+
+  ~PVecNode();
+};
+
+//
+// 永続ベクタ
+//
+// 要素を 32 分木 (bit-partitioned vector trie) の葉に持ち、
+// 末尾の 32 要素までは木に入れずに tail に持つ
+//
+// 複製は根と tail を共有するだけなので O(1)
+// 変更は根から葉までの経路の節だけをコピーするので O(log32 n) で、
+// 複製した後のバージョンどうしは残りの節を共有する
+struct ObjPVector : Object {
+  std::shared_ptr<PVecNode> root;
+  std::shared_ptr<PVecNode> tail;
+  size_t count;
+  size_t shift;  // 根の深さ * Bits
+
+  std::string to_string() const;
+  ObjPVector* clone() const;
+
+  bool equals(ObjPVector* x) const;
+
+  size_t size() const
+  {
+    return this->count;
+  }
+
+  Object* get(size_t index) const;
+  void set(size_t index, Object* obj);
+
+  void push(Object* obj);
+
+  //
+  // 末尾の要素を取り除いて、その複製を返す
+  // 空でないこと
+  Object* pop();
+
+  explicit ObjPVector(TypeInfo const& type);
+
+private:
+  //
+  // tail の先頭の要素の位置
+  size_t tail_offset() const
+  {
+    return this->count < PVecNode::Width
+             ? 0
+             : ((this->count - 1) >> PVecNode::Bits) << PVecNode::Bits;
+  }
+};
+
+//
+// 永続辞書の節 (HAMT)
+//
+// キーのハッシュ値を 5 ビットずつ区切って、32 分木をたどる
+// bitmap は使っている枝の位置で、entries はその順に詰めて持つ
+// (位置 i の要素は entries[popcount(bitmap & ((1 << i) - 1))])
+//
+// ハッシュ値がすべて一致するキーどうしは、is_collision の節に並べる
+// 共有の扱いは PVecNode と同じ
+struct HamtNode {
+  struct Entry {
+    size_t hash;
+    Object* key;  // 子を持つときは nullptr
+    Object* value;
+    std::shared_ptr<HamtNode> child;
+  };
+
+  uint32_t bitmap = 0;
+  bool is_collision = false;
+  HeapVector<Entry, TYPE_PDict> entries;
+
+  HamtNode() = default;
+  HamtNode(HamtNode const& node);
+
+  ~HamtNode();
+};
+
+//
+// 永続辞書
+//
+// 複製と変更の計算量は ObjPVector と同じ
+// 要素の順序はキーのハッシュ値の順で、追加した順ではない
+struct ObjPDict : Object {
+  std::shared_ptr<HamtNode> root;  // 空なら nullptr
+  size_t count;
+
+  std::string to_string() const;
+  ObjPDict* clone() const;
+
+  bool equals(ObjPDict* x) const;
+
+  size_t size() const
+  {
+    return this->count;
+  }
+
+  //
+  // キーに対応する値
+  // 見つからなければ nullptr
+  Object* find(Object* key) const;
+
+  //
+  // すでにあるキーなら値を置き換える
+  void set(Object* key, Object* value);
+
+  //
+  // 見つからなければ false
+  bool remove(Object* key);
+
+  //
+  // すべてのキーと値の組
+  std::vector<std::pair<Object*, Object*>> entries() const;
+
+  explicit ObjPDict(TypeInfo const& type)
+    : Object(type),
+      count(0)
+  {
+  }
+};
+
+//
+// ベクタ
+//
+// 要素の型が、すべてのメンバが値を直接持つ構造体である場合は
+// 列指向 (struct of arrays) で格納する
+// メンバごとに連続した配列を持つので、v[i].x のようなアクセスで
+// 要素のオブジェクトを作らずに済み、キャッシュの効率も良い
+//
+// 要素の型が int, usize, float, bool, char の場合は、値の配列を
+// ひとつの列として持つ (is_scalar)
+// オブジェクトは要素を取り出したときにのみ作成する
+//
+// 列は複製や部分ベクタ (v[a..b]) の間で共有され、
+// 内容を変更するときに初めてコピーする (copy on write)
+//
+// 要素には必ず get_element / set_element / append を通してアクセスすること
+//
+// 要素・列ともに、少ないうちはヒープに確保せずに持つ (SmallVector)
 struct ObjVector : Object {
-  std::vector<Object*> elements;
+  // 要素 (ポインタ) を InlineElements 個までヒープに確保せずに持つ
+  static constexpr size_t InlineElements = 8;
+
+  // 列ごとに InlineColumnBytes バイトまで、列の表と同じ領域に持つ
+  // (スカラー型なら、列の表とあわせて確保一回で済む)
+  static constexpr size_t InlineColumnBytes = 64;
+
+  using Elements = SmallVector<Object*, InlineElements,
+                               HeapAllocator<Object*, TYPE_Vector>>;
+  using Column = SmallVector<unsigned char, InlineColumnBytes,
+                             HeapAllocator<unsigned char, TYPE_Vector>>;
+  using Columns = SmallVector<Column, 1, HeapAllocator<Column, TYPE_Vector>>;
+
+  Elements elements;
+
+  //
+  // 列指向ストレージ
+  // layout が nullptr でなければ使われる
+  // 要素は columns の row_offset 行目から row_count 個
+  StructLayout const* layout;
+  std::shared_ptr<Columns> columns;
+  size_t row_offset;
+  size_t row_count;
+
+  // 要素がスカラー型 (columns[0] が値の配列)
+  bool is_scalar;
 
   std::string to_string() const;
   ObjVector* clone() const;
 
-  bool equals(ObjVector* x) const
-  {
-    if (this->elements.size() != x->elements.size())
-      return false;
+  bool equals(ObjVector* x) const;
 
-    for (auto y = x->elements.begin(); auto&& e : this->elements) {
-      if (!e->equals(*y))
-        return false;
-    }
+  bool is_columnar() const
+  {
+    return this->layout != nullptr;
+  }
 
-    return true;
+  size_t size() const
+  {
+    return this->is_columnar() ? this->row_count : this->elements.size();
   }
 
-  Object*& append(Object* obj)
+  //
+  // 要素を取得する
+  // 列指向であれば、構造体のオブジェクトを新しく作成する
+  Object* get_element(size_t index) const;
+
+  //
+  // 要素を設定する
+  void set_element(size_t index, Object* obj);
+
+  //
+  // 値の配列の先頭
+  // is_scalar のときのみ
+  template <class T>
+  T const* scalar_data() const
   {
-    auto& ret = this->elements.emplace_back(obj);
+    return (T const*)this->column_ptr(0, 0);
+  }
 
-    ret->ref_count++;
+  //
+  // 変更する場合はこちら
+  template <class T>
+  T* mutable_scalar_data()
+  {
+    this->make_unique();
+    return (T*)this->column_ptr(0, 0);
+  }
 
-    return ret;
+  //
+  // f 番目の列の、自分の範囲のバイト列
+  std::string_view column_view(size_t f) const
+  {
+    return std::string_view(
+      (char const*)this->column_ptr(0, f),
+      this->row_count *
+        StructLayout::get_inline_size(this->layout->fields[f].kind));
   }
 
+  //
+  // 要素を並べ替える
+  // 新しい i 番目の要素は、元の order[i] 番目の要素
+  void permute(std::vector<size_t> const& order);
+
+  //
+  // 部分ベクタ [begin, end) を作成する
+  // 列指向であれば、列を共有する
+  ObjVector* slice(size_t begin, size_t end) const;
+
+  //
+  // 列指向の要素のメンバを取得・設定する
+  Object* get_field(size_t index, size_t field) const;
+  void set_field(size_t index, size_t field, Object* obj);
+
+  Object* append(Object* obj);
+
+  //
+  // n 個まで、領域を作り直さずに追加できるようにする
+  void reserve(size_t n);
+
+  //
+  // x の要素を末尾にまとめて追加する
+  // 格納方法が同じであれば、列またはポインタの配列をそのままコピーする
+  void extend(ObjVector const* x);
+
+  //
+  // 要素数を n にする
+  // 増えた部分は value の複製で埋める
+  void resize(size_t n, Object* value);
+
+  //
+  // 先頭の n 個だけを残す
+  void truncate(size_t n);
+
+  void shrink_to_fit();
+
   ObjVector()
-    : Object(TYPE_Vector)
+    : Object(TYPE_Vector),
+      layout(nullptr),
+      row_offset(0),
+      row_count(0),
+      is_scalar(false)
   {
   }
 
-  ObjVector(std::vector<Object*>&& elems)
+  //
+  // 要素の型から格納方法を決める
+  explicit ObjVector(TypeInfo const& type);
+
+  ObjVector(Elements&& elems)
     : Object(TYPE_Vector),
-      elements(std::move(elems))
+      elements(std::move(elems)),
+      layout(nullptr),
+      row_offset(0),
+      row_count(0),
+      is_scalar(false)
   {
     for (auto&& e : this->elements) {
       e->ref_count++;
@@ -443,4 +1485,16 @@ struct ObjVector : Object {
       elem->ref_count--;
     }
   }
+
+private:
+  unsigned char* column_ptr(size_t index, size_t field) const
+  {
+    return (unsigned char*)(*this->columns)[field].data() +
+           (this->row_offset + index) *
+             StructLayout::get_inline_size(this->layout->fields[field].kind);
+  }
+
+  //
+  // 列を他と共有していれば、自分の範囲だけをコピーする
+  void make_unique();
 };
@@ -1,21 +1,29 @@
 #pragma once
 
 #include <string>
-#include <codecvt>
-#include <locale>
+#include <string_view>
+#include "Heap.h"
 
 using metro_char_t = char16_t;
 
-class metro_string_t : public std::basic_string<metro_char_t> {
-  static inline std::wstring_convert<std::codecvt_utf8_utf16<metro_char_t>,
-                                     metro_char_t>
-    conv;
+//
+// 文字列の領域は、文字列 (TYPE_String) の使用量として数える
+using metro_string_base =
+  std::basic_string<metro_char_t, std::char_traits<metro_char_t>,
+                    HeapAllocator<metro_char_t, TYPE_String>>;
 
+class metro_string_t : public metro_string_base {
 public:
-  using std::basic_string<metro_char_t>::basic_string;
+  using metro_string_base::metro_string_base;
 
-  std::string to_string() const
-  {
-    return conv.to_bytes(*this);
-  }
+  //
+  // UTF-8 に変換する
+  std::string to_string() const;
+
+  static std::string to_string(std::u16string_view str);
+
+  //
+  // UTF-8 から変換する
+  // 不正なバイト列は U+FFFD に置き換える
+  static metro_string_t from_utf8(std::string_view str);
 };
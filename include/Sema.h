@@ -83,6 +83,13 @@ class Sema {
 
     bool is_global = 0;
 
+    //
+    // スカラー置換された構造体のメンバ
+    //   name   = 構造体の変数名
+    //   member = メンバ名
+    bool is_scalar_member = 0;
+    std::string_view member;
+
     explicit LocalVar(TypeInfo const& type, std::string_view name)
       : type(type),
         name(name)
@@ -98,7 +105,7 @@ class Sema {
     LocalVar* find_var(std::string_view name)
     {
       for (auto&& var : this->variables)
-        if (var.name == name)
+        if (var.name == name && !var.is_scalar_member)
           return &var;
 
       return nullptr;
@@ -220,6 +227,15 @@ public:
   std::tuple<LocalVar*, size_t, size_t> find_variable(
     std::string_view const& name);
 
+  //
+  // スカラー置換された構造体のメンバを探す
+  std::tuple<LocalVar*, size_t, size_t> find_scalar_member(
+    std::string_view const& name, std::string_view const& member);
+
+  //
+  // スコープ内で外に出ない構造体の変数を探す (スカラー置換)
+  void find_scalar_replaceable(AST::Scope* ast);
+
   //
   // 関数を探す
   FunctionFindResult find_function(std::string_view name, bool have_self,
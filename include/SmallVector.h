@@ -0,0 +1,427 @@
+// ---------------------------------------------
+//  SmallVector
+//
+//  N 個までの要素を自身の中に持ち、それを超えたときにだけ
+//  ヒープに確保する可変長配列
+//
+//  std::vector と同じように使えるが、インラインに持っている間は
+//  移動 (move) で要素も移動するので、要素へのポインタは無効になる
+//  Alloc は状態を持たないアロケータであること
+// ---------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+template <class T, size_t N, class Alloc = std::allocator<T>>
+class SmallVector {
+public:
+  using value_type = T;
+  using size_type = size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = T&;
+  using const_reference = T const&;
+  using pointer = T*;
+  using const_pointer = T const*;
+  using iterator = T*;
+  using const_iterator = T const*;
+  using reverse_iterator = std::reverse_iterator<iterator>;
+  using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+  SmallVector() noexcept
+    : ptr(this->inline_data()),
+      count(0),
+      cap(N)
+  {
+  }
+
+  explicit SmallVector(size_t n)
+    : SmallVector()
+  {
+    this->resize(n);
+  }
+
+  SmallVector(size_t n, T const& value)
+    : SmallVector()
+  {
+    this->resize(n, value);
+  }
+
+  SmallVector(std::initializer_list<T> list)
+    : SmallVector()
+  {
+    this->assign(list.begin(), list.end());
+  }
+
+  template <std::input_iterator It>
+  SmallVector(It first, It last)
+    : SmallVector()
+  {
+    this->assign(first, last);
+  }
+
+  template <class A>
+  SmallVector(std::vector<T, A>&& vec)
+    : SmallVector()
+  {
+    this->assign(std::make_move_iterator(vec.begin()),
+                 std::make_move_iterator(vec.end()));
+  }
+
+  SmallVector(SmallVector const& x)
+    : SmallVector()
+  {
+    this->assign(x.begin(), x.end());
+  }
+
+  SmallVector(SmallVector&& x) noexcept
+    : SmallVector()
+  {
+    this->steal(x);
+  }
+
+  ~SmallVector()
+  {
+    this->clear();
+    this->release();
+  }
+
+  SmallVector& operator=(SmallVector const& x)
+  {
+    if (this != &x)
+      this->assign(x.begin(), x.end());
+
+    return *this;
+  }
+
+  SmallVector& operator=(SmallVector&& x) noexcept
+  {
+    if (this != &x) {
+      this->clear();
+      this->release();
+      this->steal(x);
+    }
+
+    return *this;
+  }
+
+  iterator begin() noexcept
+  {
+    return this->ptr;
+  }
+
+  const_iterator begin() const noexcept
+  {
+    return this->ptr;
+  }
+
+  iterator end() noexcept
+  {
+    return this->ptr + this->count;
+  }
+
+  const_iterator end() const noexcept
+  {
+    return this->ptr + this->count;
+  }
+
+  reverse_iterator rbegin() noexcept
+  {
+    return reverse_iterator(this->end());
+  }
+
+  const_reverse_iterator rbegin() const noexcept
+  {
+    return const_reverse_iterator(this->end());
+  }
+
+  reverse_iterator rend() noexcept
+  {
+    return reverse_iterator(this->begin());
+  }
+
+  const_reverse_iterator rend() const noexcept
+  {
+    return const_reverse_iterator(this->begin());
+  }
+
+  T* data() noexcept
+  {
+    return this->ptr;
+  }
+
+  T const* data() const noexcept
+  {
+    return this->ptr;
+  }
+
+  size_t size() const noexcept
+  {
+    return this->count;
+  }
+
+  bool empty() const noexcept
+  {
+    return this->count == 0;
+  }
+
+  size_t capacity() const noexcept
+  {
+    return this->cap;
+  }
+
+  //
+  // ヒープに確保せず、自身の中に持っている
+  bool is_inline() const noexcept
+  {
+    return this->ptr == this->inline_data();
+  }
+
+  T& operator[](size_t index)
+  {
+    return this->ptr[index];
+  }
+
+  T const& operator[](size_t index) const
+  {
+    return this->ptr[index];
+  }
+
+  T& front()
+  {
+    return this->ptr[0];
+  }
+
+  T const& front() const
+  {
+    return this->ptr[0];
+  }
+
+  T& back()
+  {
+    return this->ptr[this->count - 1];
+  }
+
+  T const& back() const
+  {
+    return this->ptr[this->count - 1];
+  }
+
+  void reserve(size_t n)
+  {
+    if (n > this->cap)
+      this->reallocate(n);
+  }
+
+  template <class... Args>
+  T& emplace_back(Args&&... args)
+  {
+    if (this->count == this->cap) {
+      // args が自身の要素を指していることがあるので、先に作っておく
+      T tmp(std::forward<Args>(args)...);
+
+      this->reallocate(this->cap * 2);
+
+      return *::new (this->ptr + this->count++) T(std::move(tmp));
+    }
+
+    return *::new (this->ptr + this->count++) T(std::forward<Args>(args)...);
+  }
+
+  void push_back(T const& value)
+  {
+    this->emplace_back(value);
+  }
+
+  void push_back(T&& value)
+  {
+    this->emplace_back(std::move(value));
+  }
+
+  void pop_back()
+  {
+    this->ptr[--this->count].~T();
+  }
+
+  void resize(size_t n)
+  {
+    this->resize_with(n, [](T* p) { ::new (p) T(); });
+  }
+
+  void resize(size_t n, T const& value)
+  {
+    // value が自身の要素を指していることがあるので、コピーしておく
+    T tmp(value);
+
+    this->resize_with(n, [&tmp](T* p) { ::new (p) T(tmp); });
+  }
+
+  void clear() noexcept
+  {
+    std::destroy(this->begin(), this->end());
+    this->count = 0;
+  }
+
+  //
+  // 範囲は自身の要素でないこと
+  template <std::input_iterator It>
+  void assign(It first, It last)
+  {
+    this->clear();
+    this->insert(this->end(), first, last);
+  }
+
+  //
+  // 範囲は自身の要素でないこと
+  template <std::input_iterator It>
+  iterator insert(const_iterator pos, It first, It last)
+  {
+    auto offset = pos - this->begin();
+    auto old_count = this->count;
+
+    if constexpr (std::forward_iterator<It>)
+      this->reserve(this->count + std::distance(first, last));
+
+    // 末尾に追加してから、pos の位置まで回転させる
+    for (; first != last; ++first)
+      this->emplace_back(*first);
+
+    std::rotate(this->begin() + offset, this->begin() + old_count,
+                this->end());
+
+    return this->begin() + offset;
+  }
+
+  iterator erase(const_iterator first, const_iterator last)
+  {
+    auto dest = this->begin() + (first - this->begin());
+    auto src = this->begin() + (last - this->begin());
+
+    auto new_end = std::move(src, this->end(), dest);
+
+    std::destroy(new_end, this->end());
+    this->count = new_end - this->begin();
+
+    return dest;
+  }
+
+  iterator erase(const_iterator pos)
+  {
+    return this->erase(pos, pos + 1);
+  }
+
+  //
+  // N 個以下になっていれば、自身の中に戻す
+  void shrink_to_fit()
+  {
+    if (this->is_inline() || this->count == this->cap)
+      return;
+
+    if (this->count > N) {
+      this->reallocate(this->count);
+      return;
+    }
+
+    auto p = this->ptr;
+    auto n = this->cap;
+
+    this->ptr = this->inline_data();
+    this->cap = N;
+
+    std::uninitialized_move(p, p + this->count, this->ptr);
+    std::destroy(p, p + this->count);
+    Alloc().deallocate(p, n);
+  }
+
+  friend bool operator==(SmallVector const& a, SmallVector const& b)
+  {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end());
+  }
+
+private:
+  T* ptr;
+  size_t count;
+  size_t cap;
+
+  alignas(T) unsigned char storage[sizeof(T) * N];
+
+  T* inline_data() noexcept
+  {
+    return reinterpret_cast<T*>(this->storage);
+  }
+
+  T const* inline_data() const noexcept
+  {
+    return reinterpret_cast<T const*>(this->storage);
+  }
+
+  //
+  // 大きさ n の領域をヒープに確保して、要素を移す
+  void reallocate(size_t n)
+  {
+    auto p = Alloc().allocate(n);
+
+    std::uninitialized_move(this->begin(), this->end(), p);
+    std::destroy(this->begin(), this->end());
+
+    this->release();
+
+    this->ptr = p;
+    this->cap = n;
+  }
+
+  //
+  // ヒープの領域を解放して、自身の中に戻す (要素は破棄済みであること)
+  void release() noexcept
+  {
+    if (!this->is_inline())
+      Alloc().deallocate(this->ptr, this->cap);
+
+    this->ptr = this->inline_data();
+    this->cap = N;
+  }
+
+  //
+  // x の要素を移す (自身は空で、自身の中に持っていること)
+  void steal(SmallVector& x) noexcept
+  {
+    if (x.is_inline()) {
+      std::uninitialized_move(x.begin(), x.end(), this->ptr);
+      this->count = x.count;
+      x.clear();
+      return;
+    }
+
+    this->ptr = x.ptr;
+    this->count = x.count;
+    this->cap = x.cap;
+
+    x.ptr = x.inline_data();
+    x.count = 0;
+    x.cap = N;
+  }
+
+  template <class Construct>
+  void resize_with(size_t n, Construct construct)
+  {
+    if (n <= this->count) {
+      std::destroy(this->begin() + n, this->end());
+      this->count = n;
+      return;
+    }
+
+    // 少しずつ大きくしても、再確保が O(log n) 回で済むようにする
+    if (n > this->cap)
+      this->reallocate(std::max(n, this->cap * 2));
+
+    for (; this->count < n; this->count++)
+      construct(this->ptr + this->count);
+  }
+};
@@ -0,0 +1,385 @@
+// ---------------------------------------------
+//  Sort
+//
+//  pdqsort (pattern-defeating quicksort) と、
+//  大きな配列を分割して複数のスレッドで並べ替えるマージソート
+// ---------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Sort {
+
+// これより小さい範囲は挿入ソート
+constexpr size_t InsertionSortThreshold = 24;
+
+// これより大きい範囲は、ピボットを 9 つの要素から選ぶ
+constexpr size_t NintherThreshold = 128;
+
+// 整列済みとみなして挿入ソートを試すときに、移動してよい要素の数
+constexpr size_t PartialInsertionSortLimit = 8;
+
+// これより大きい配列は、複数のスレッドで並べ替える
+constexpr size_t ParallelThreshold = 1 << 16;
+
+namespace detail {
+
+template <class T, class Comp>
+void insertion_sort(T* begin, T* end, Comp& comp)
+{
+  if (begin == end)
+    return;
+
+  for (T* cur = begin + 1; cur != end; cur++) {
+    T* sift = cur;
+    T* sift_1 = cur - 1;
+
+    if (comp(*sift, *sift_1)) {
+      T tmp = std::move(*sift);
+
+      do {
+        *sift-- = std::move(*sift_1);
+      } while (sift != begin && comp(tmp, *--sift_1));
+
+      *sift = std::move(tmp);
+    }
+  }
+}
+
+//
+// begin の直前に、範囲内のどの要素よりも小さくない要素があること
+template <class T, class Comp>
+void unguarded_insertion_sort(T* begin, T* end, Comp& comp)
+{
+  if (begin == end)
+    return;
+
+  for (T* cur = begin + 1; cur != end; cur++) {
+    T* sift = cur;
+    T* sift_1 = cur - 1;
+
+    if (comp(*sift, *sift_1)) {
+      T tmp = std::move(*sift);
+
+      do {
+        *sift-- = std::move(*sift_1);
+      } while (comp(tmp, *--sift_1));
+
+      *sift = std::move(tmp);
+    }
+  }
+}
+
+//
+// 移動が少なければ挿入ソートで済ませる
+// 多すぎたら途中でやめて false を返す
+template <class T, class Comp>
+bool partial_insertion_sort(T* begin, T* end, Comp& comp)
+{
+  if (begin == end)
+    return true;
+
+  size_t moved = 0;
+
+  for (T* cur = begin + 1; cur != end; cur++) {
+    T* sift = cur;
+    T* sift_1 = cur - 1;
+
+    if (comp(*sift, *sift_1)) {
+      T tmp = std::move(*sift);
+
+      do {
+        *sift-- = std::move(*sift_1);
+      } while (sift != begin && comp(tmp, *--sift_1));
+
+      *sift = std::move(tmp);
+      moved += cur - sift;
+    }
+
+    if (moved > PartialInsertionSortLimit)
+      return false;
+  }
+
+  return true;
+}
+
+template <class T, class Comp>
+void sort2(T* a, T* b, Comp& comp)
+{
+  if (comp(*b, *a))
+    std::iter_swap(a, b);
+}
+
+template <class T, class Comp>
+void sort3(T* a, T* b, T* c, Comp& comp)
+{
+  sort2(a, b, comp);
+  sort2(b, c, comp);
+  sort2(a, b, comp);
+}
+
+//
+// *begin をピボットにして、ピボットより小さいものを左に集める
+// (ピボットと等しいものは右)
+// 戻り値: ピボットの位置と、最初から分割済みだったか
+template <class T, class Comp>
+std::pair<T*, bool> partition_right(T* begin, T* end, Comp& comp)
+{
+  T pivot = std::move(*begin);
+
+  T* first = begin;
+  T* last = end;
+
+  while (comp(*++first, pivot))
+    ;
+
+  if (first - 1 == begin)
+    while (first < last && !comp(*--last, pivot))
+      ;
+  else
+    while (!comp(*--last, pivot))
+      ;
+
+  bool already_partitioned = first >= last;
+
+  while (first < last) {
+    std::iter_swap(first, last);
+
+    while (comp(*++first, pivot))
+      ;
+
+    while (!comp(*--last, pivot))
+      ;
+  }
+
+  T* pivot_pos = first - 1;
+
+  *begin = std::move(*pivot_pos);
+  *pivot_pos = std::move(pivot);
+
+  return {pivot_pos, already_partitioned};
+}
+
+//
+// ピボットと等しいものを左に集める
+// (同じ値が多いときに、それらをまとめて除く)
+template <class T, class Comp>
+T* partition_left(T* begin, T* end, Comp& comp)
+{
+  T pivot = std::move(*begin);
+
+  T* first = begin;
+  T* last = end;
+
+  while (comp(pivot, *--last))
+    ;
+
+  if (last + 1 == end)
+    while (first < last && !comp(pivot, *++first))
+      ;
+  else
+    while (!comp(pivot, *++first))
+      ;
+
+  while (first < last) {
+    std::iter_swap(first, last);
+
+    while (comp(pivot, *--last))
+      ;
+
+    while (!comp(pivot, *++first))
+      ;
+  }
+
+  T* pivot_pos = last;
+
+  *begin = std::move(*pivot_pos);
+  *pivot_pos = std::move(pivot);
+
+  return pivot_pos;
+}
+
+template <class T, class Comp>
+void pdqsort_loop(T* begin, T* end, Comp& comp, int bad_allowed, bool leftmost)
+{
+  while (true) {
+    size_t size = end - begin;
+
+    if (size < InsertionSortThreshold) {
+      if (leftmost)
+        insertion_sort(begin, end, comp);
+      else
+        unguarded_insertion_sort(begin, end, comp);
+
+      return;
+    }
+
+    // ピボットを選んで begin に置く
+    size_t s2 = size / 2;
+
+    if (size > NintherThreshold) {
+      sort3(begin, begin + s2, end - 1, comp);
+      sort3(begin + 1, begin + (s2 - 1), end - 2, comp);
+      sort3(begin + 2, begin + (s2 + 1), end - 3, comp);
+      sort3(begin + (s2 - 1), begin + s2, begin + (s2 + 1), comp);
+      std::iter_swap(begin, begin + s2);
+    }
+    else {
+      sort3(begin + s2, begin, end - 1, comp);
+    }
+
+    // 直前の要素 (前回のピボット) と等しい
+    //  --> 等しいものをまとめて、残りだけを並べ替える
+    if (!leftmost && !comp(*(begin - 1), *begin)) {
+      begin = partition_left(begin, end, comp) + 1;
+      continue;
+    }
+
+    auto [pivot_pos, already_partitioned] =
+      partition_right(begin, end, comp);
+
+    size_t l_size = pivot_pos - begin;
+    size_t r_size = end - (pivot_pos + 1);
+
+    if (l_size < size / 8 || r_size < size / 8) {
+      // 偏った分割が続いたら、ヒープソートに切り替える
+      if (--bad_allowed == 0) {
+        std::make_heap(begin, end, comp);
+        std::sort_heap(begin, end, comp);
+        return;
+      }
+
+      // 要素を入れ替えて、同じパターンが続かないようにする
+      if (l_size >= InsertionSortThreshold) {
+        std::iter_swap(begin, begin + l_size / 4);
+        std::iter_swap(pivot_pos - 1, pivot_pos - l_size / 4);
+
+        if (l_size > NintherThreshold) {
+          std::iter_swap(begin + 1, begin + (l_size / 4 + 1));
+          std::iter_swap(begin + 2, begin + (l_size / 4 + 2));
+          std::iter_swap(pivot_pos - 2, pivot_pos - (l_size / 4 + 1));
+          std::iter_swap(pivot_pos - 3, pivot_pos - (l_size / 4 + 2));
+        }
+      }
+
+      if (r_size >= InsertionSortThreshold) {
+        std::iter_swap(pivot_pos + 1, pivot_pos + (1 + r_size / 4));
+        std::iter_swap(end - 1, end - r_size / 4);
+
+        if (r_size > NintherThreshold) {
+          std::iter_swap(pivot_pos + 2, pivot_pos + (2 + r_size / 4));
+          std::iter_swap(pivot_pos + 3, pivot_pos + (3 + r_size / 4));
+          std::iter_swap(end - 2, end - (1 + r_size / 4));
+          std::iter_swap(end - 3, end - (2 + r_size / 4));
+        }
+      }
+    }
+    // 分割済みだった
+    //  --> 整列済みに近いかもしれないので、挿入ソートを試す
+    else if (already_partitioned &&
+             partial_insertion_sort(begin, pivot_pos, comp) &&
+             partial_insertion_sort(pivot_pos + 1, end, comp)) {
+      return;
+    }
+
+    // 左は再帰、右はループで続ける
+    pdqsort_loop(begin, pivot_pos, comp, bad_allowed, leftmost);
+
+    begin = pivot_pos + 1;
+    leftmost = false;
+  }
+}
+
+}  // namespace detail
+
+//
+// [begin, end) を comp の順に並べ替える (安定ではない)
+template <class T, class Comp>
+void pdqsort(T* begin, T* end, Comp comp)
+{
+  if (end - begin < 2)
+    return;
+
+  detail::pdqsort_loop(begin, end, comp, std::bit_width(size_t(end - begin)),
+                       true);
+}
+
+//
+// 大きな配列は、スレッドの数に分割してそれぞれを並べ替え、
+// 隣どうしを並行してマージしていく
+// 小さければ、そのまま並べ替える
+//
+// comp は複数のスレッドから呼ばれるので、何も変更しないこと
+template <class T, class Comp>
+void parallel_sort(T* begin, T* end, Comp comp, bool stable)
+{
+  size_t n = end - begin;
+  size_t threads = std::min(std::thread::hardware_concurrency(), 8u);
+
+  if (n < ParallelThreshold || threads < 2) {
+    if (stable)
+      std::stable_sort(begin, end, comp);
+    else
+      pdqsort(begin, end, comp);
+
+    return;
+  }
+
+  // 分割数は 2 のべき乗にする
+  size_t parts = std::bit_floor(threads);
+
+  std::vector<T*> bounds(parts + 1);
+
+  for (size_t i = 0; i <= parts; i++)
+    bounds[i] = begin + n * i / parts;
+
+  {
+    std::vector<std::jthread> workers;
+
+    for (size_t i = 0; i < parts; i++) {
+      workers.emplace_back([&, i] {
+        if (stable)
+          std::stable_sort(bounds[i], bounds[i + 1], comp);
+        else
+          pdqsort(bounds[i], bounds[i + 1], comp);
+      });
+    }
+  }
+
+  // std::merge は等しい要素を左から取るので、安定
+  auto buffer = std::make_unique<T[]>(n);
+
+  T* src = begin;
+  T* dest = buffer.get();
+
+  for (size_t width = 1; width < parts; width *= 2) {
+    std::vector<std::jthread> workers;
+
+    for (size_t i = 0; i < parts; i += width * 2) {
+      workers.emplace_back([&, i] {
+        auto first = bounds[i] - begin;
+        auto mid = bounds[i + width] - begin;
+        auto last = bounds[std::min(i + width * 2, parts)] - begin;
+
+        std::merge(std::make_move_iterator(src + first),
+                   std::make_move_iterator(src + mid),
+                   std::make_move_iterator(src + mid),
+                   std::make_move_iterator(src + last), dest + first, comp);
+      });
+    }
+
+    workers.clear();
+    std::swap(src, dest);
+  }
+
+  if (src != begin)
+    std::move(src, src + n, begin);
+}
+
+}  // namespace Sort
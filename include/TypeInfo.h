@@ -26,7 +26,15 @@ enum TypeKind {
   TYPE_Range,
   TYPE_Vector,
   TYPE_Dict,
+  TYPE_Set,
+  TYPE_Deque,
+  TYPE_Heap,
+  TYPE_Bitset,
+  TYPE_NdArray,
+  TYPE_PVector,
+  TYPE_PDict,
   TYPE_Args,
+  TYPE_StringBuilder,
   TYPE_UserDef,  // user-defined
   TYPE_Template,  // only used in Sema
 };
@@ -81,6 +89,12 @@ struct TypeInfo {
     switch (this->kind) {
       case TYPE_Vector:
       case TYPE_Dict:
+      case TYPE_Set:
+      case TYPE_Deque:
+      case TYPE_Heap:
+      case TYPE_NdArray:
+      case TYPE_PVector:
+      case TYPE_PDict:
         return true;
     }
 
@@ -117,6 +131,11 @@ struct TypeInfo {
       case TYPE_Range:
       case TYPE_Vector:
       case TYPE_Dict:
+      case TYPE_Set:
+      case TYPE_Deque:
+      case TYPE_Bitset:
+      case TYPE_PVector:
+      case TYPE_PDict:
         return true;
     }
 
@@ -151,3 +170,49 @@ struct TypeInfo {
     return ret;
   }
 };
+
+//
+// 構造体のメモリ配置
+//
+// スカラー型 (int, usize, float, bool, char) のメンバは値を直接、
+// それ以外のメンバはオブジェクトへのポインタを持つ
+struct StructLayout {
+  struct Field {
+    TypeKind kind;
+    bool is_inline;  // 値を直接持つ
+    size_t offset;
+  };
+
+  std::vector<Field> fields;
+
+  // 全体のサイズ (バイト)
+  size_t size;
+
+  //
+  // すべてのメンバが値を直接持つ場合 true
+  bool is_plain() const
+  {
+    for (auto&& f : this->fields)
+      if (!f.is_inline)
+        return false;
+
+    return true;
+  }
+
+  StructLayout()
+    : size(0)
+  {
+  }
+
+  explicit StructLayout(std::vector<TypeInfo> const& member_types);
+
+  //
+  // 値を直接持つ場合のサイズ
+  // ポインタで持つ場合は 0
+  static size_t get_inline_size(TypeKind kind);
+
+  //
+  // kind の値をひとつだけ持つレイアウト
+  // kind は値を直接持つ型であること
+  static StructLayout const& get_scalar_layout(TypeKind kind);
+};
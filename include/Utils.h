@@ -56,9 +56,6 @@ std::string join(std::string const& s, T&& x)
   });
 }
 
-std::wstring to_wstr(std::string const& str);
-std::string to_str(std::wstring const& str);
-
 }  // namespace String
 
 }  // namespace Utils
@@ -206,7 +206,8 @@ VariableDeclaration::VariableDeclaration(Token const& token)
     index(0),
     is_shadowing(false),
     is_const(false),
-    ignore_initializer(false)
+    ignore_initializer(false),
+    is_scalar_replaced(false)
 {
 }
 
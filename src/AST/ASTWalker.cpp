@@ -148,6 +148,51 @@ bool walk(AST::Base* _ast, std::function<bool(AST::Base*)> func)
              walk(ast->if_false, func);
     }
 
+    case AST_Switch: {
+      astdef(Switch);
+
+      if (!walk(ast->expr, func))
+        return false;
+
+      for (auto&& c : ast->cases)
+        if (!walk(c, func))
+          return false;
+
+      break;
+    }
+
+    case AST_Case: {
+      astdef(Case);
+      return walk(ast->cond, func) && walk(ast->scope, func);
+    }
+
+    case AST_Loop:
+      return walk(((AST::Loop*)_ast)->code, func);
+
+    case AST_For: {
+      astdef(For);
+      return walk(ast->iter, func) && walk(ast->iterable, func) &&
+             walk(ast->code, func);
+    }
+
+    case AST_While: {
+      astdef(While);
+      return walk(ast->cond, func) && walk(ast->code, func);
+    }
+
+    case AST_DoWhile: {
+      astdef(DoWhile);
+      return walk(ast->code, func) && walk(ast->cond, func);
+    }
+
+    case AST_Argument:
+      return walk(((AST::Argument*)_ast)->type, func);
+
+    case AST_Enum:
+    case AST_Struct:
+    case AST_Impl:
+      break;
+
     case AST_Scope: {
       astdef(Scope);
 
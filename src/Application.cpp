@@ -11,17 +11,50 @@
 #include "ScriptFileContext.h"
 #include "Application.h"
 #include "Error.h"
+#include "Heap.h"
 
 static char const* g_help_string = R"(
 usage:
     metro [options] [input files]
 
 options:
-    --help, -h      show this messages
+    --help, -h          show this messages
+    --max-heap=<size>   limit the heap usage of objects
+                        (bytes, or with suffix K, M, G)
+    --heap-dump=<file>  write a snapshot of live objects to file
+                        after execution (see srctools/metro-heap.py)
 )";
 
 static Application* _g_inst;
 
+//
+// "64M" のようなサイズの指定を解析する
+static size_t parse_size(std::string const& str)
+{
+  size_t pos = 0;
+  size_t size = 0;
+
+  try {
+    size = std::stoull(str, &pos);
+  }
+  catch (...) {
+    Error::fatal_error("invalid size: '", str, "'");
+  }
+
+  auto suffix = str.substr(pos);
+
+  if (suffix == "K" || suffix == "k")
+    size <<= 10;
+  else if (suffix == "M" || suffix == "m")
+    size <<= 20;
+  else if (suffix == "G" || suffix == "g")
+    size <<= 30;
+  else if (!suffix.empty())
+    Error::fatal_error("invalid size: '", str, "'");
+
+  return size;
+}
+
 Application::Application()
   : _cur_ctx(nullptr)
 {
@@ -76,6 +109,16 @@ int Application::main(int argc, char** argv)
         Error::fatal_error("missing option name");
       }
 
+      if (arg.starts_with("max-heap=")) {
+        Heap::set_limit(parse_size(arg.substr(9)));
+        continue;
+      }
+
+      if (arg.starts_with("heap-dump=")) {
+        Heap::set_dump_path(arg.substr(10));
+        continue;
+      }
+
       Error::fatal_error("unknown option name: '", arg, "'");
     }
 
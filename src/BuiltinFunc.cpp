@@ -1,98 +1,1291 @@
 #include <iostream>
 #include <fstream>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <numeric>
 
 #include "Utils.h"
 #include "Debug.h"
 
+#include "AST/AST.h"
 #include "Object/Object.h"
 #include "BuiltinFunc.h"
 #include "Error.h"
+#include "Heap.h"
+#include "Kernel.h"
+#include "Sort.h"
 
 #define DEFINE_BUILTIN_FUNC(name) \
   static Object* name(BuiltinFunc::ArgumentVector const& args)
 
+// self を持つ関数は self を変更しないこと (BuiltinFunc::borrow_self)
 #define BUILTIN_FUNC_FULL(Name, Impl, IsTemplate, IsHaveSelf, SelfType,     \
                           ResultType, ArgTypes...)                          \
   BuiltinFunc                                                               \
   {                                                                         \
     .name = Name, .is_template = IsTemplate, .have_self = IsHaveSelf,       \
     .self_type = SelfType, .result_type = ResultType, .arg_types{ArgTypes}, \
-    .impl = Impl                                                            \
+    .impl = Impl, .borrow_self = IsHaveSelf                                 \
+  }
+
+// self を変更する (BuiltinFunc::modify_self)
+#define BUILTIN_FUNC_MODIFY_SELF(Name, Impl, IsTemplate, SelfType,          \
+                                 ResultType, ArgTypes...)                   \
+  BuiltinFunc                                                               \
+  {                                                                         \
+    .name = Name, .is_template = IsTemplate, .have_self = true,             \
+    .self_type = SelfType, .result_type = ResultType, .arg_types{ArgTypes}, \
+    .impl = Impl, .modify_self = true                                       \
   }
 
 #define BUILTIN_FUNC(Name, Impl, ResultType, ArgTypes...) \
   BUILTIN_FUNC_FULL(Name, Impl, false, false, {}, ResultType, ArgTypes)
 
-#define BUILTIN_FUNC_TEMPLATE(Name, Impl, ResultType, ArgTypes...) \
-  BUILTIN_FUNC_FULL(Name, Impl, true, false, {}, ResultType, ArgTypes)
+#define BUILTIN_FUNC_TEMPLATE(Name, Impl, ResultType, ArgTypes...) \
+  BUILTIN_FUNC_FULL(Name, Impl, true, false, {}, ResultType, ArgTypes)
+
+namespace builtin {
+
+//
+// 要素として格納する値
+// 即値 (リテラル) は構文木ごとに共有されているので、複製する
+// (変数などはすでに複製されている)
+static Object* stored_value(BuiltinFunc::ArgumentObject const& arg)
+{
+  return arg.ast->kind == AST_Value ? arg.object->clone() : arg.object;
+}
+
+DEFINE_BUILTIN_FUNC(print)
+{
+  size_t len = 0;
+
+  for (auto&& arg : args) {
+    auto s = arg.object->to_string();
+
+    std::cout << s;
+
+    len += s.length();
+  }
+
+  return new ObjLong(len);
+}
+
+DEFINE_BUILTIN_FUNC(println)
+{
+  auto ret = print(args);
+
+  std::cout << "\n";
+  ((ObjLong*)ret)->value += 1;
+
+  return ret;
+}
+
+//
+// id(T)
+DEFINE_BUILTIN_FUNC(id)
+{
+  return ObjString::from_u8_string(Utils::format("%p", args[0]));
+}
+
+//
+// type(T)
+DEFINE_BUILTIN_FUNC(type)
+{
+  return ObjString::from_u8_string(args[0].object->type.to_string());
+}
+
+//
+// to_string(T)
+DEFINE_BUILTIN_FUNC(to_string)
+{
+  return ObjString::from_u8_string(args[0].object->to_string());
+}
+
+//
+// length(string)
+DEFINE_BUILTIN_FUNC(length)
+{
+  return new ObjUSize(((ObjString*)args[0].object)->length());
+}
+
+//
+// push(vector<T>)
+DEFINE_BUILTIN_FUNC(push)
+{
+  return ((ObjVector*)args[0].object)->append(stored_value(args[1]));
+}
+
+//
+// dict<K, V>.get(K, V)
+//
+// キーがなければ、追加せずに二つ目の引数を返す
+DEFINE_BUILTIN_FUNC(dict_get)
+{
+  auto item = ((ObjDict*)args[0].object)->find(args[1].object);
+
+  return item ? item->value->clone() : stored_value(args[2]);
+}
+
+//
+// dict<K, V>.contains(K)
+DEFINE_BUILTIN_FUNC(dict_contains)
+{
+  return new ObjBool(((ObjDict*)args[0].object)->find(args[1].object));
+}
+
+//
+// dict<K, V>.remove(K)
+DEFINE_BUILTIN_FUNC(dict_remove)
+{
+  return new ObjBool(((ObjDict*)args[0].object)->remove(args[1].object));
+}
+
+//
+// set<T>
+//
+// insert, remove は self を変更する (modify_self)
+DEFINE_BUILTIN_FUNC(set_insert)
+{
+  return new ObjBool(((ObjSet*)args[0].object)->insert(stored_value(args[1])));
+}
+
+DEFINE_BUILTIN_FUNC(set_contains)
+{
+  return new ObjBool(((ObjSet*)args[0].object)->contains(args[1].object));
+}
+
+DEFINE_BUILTIN_FUNC(set_remove)
+{
+  return new ObjBool(((ObjSet*)args[0].object)->remove(args[1].object));
+}
+
+DEFINE_BUILTIN_FUNC(set_len)
+{
+  return new ObjLong(((ObjSet*)args[0].object)->size());
+}
+
+//
+// a.union(b)
+DEFINE_BUILTIN_FUNC(set_union)
+{
+  auto ret = ((ObjSet*)args[0].object)->clone();
+
+  for (auto&& item : ((ObjSet*)args[1].object)->items) {
+    if (!item.is_removed() && !ret->contains(item.key))
+      ret->insert(item.key->clone());
+  }
+
+  return ret;
+}
+
+//
+// a.intersection(b)
+DEFINE_BUILTIN_FUNC(set_intersection)
+{
+  auto a = (ObjSet*)args[0].object;
+  auto b = (ObjSet*)args[1].object;
+
+  auto ret = new ObjSet(a->type);
+
+  // 小さい方を走査する (順序は小さい方に従う)
+  if (b->size() < a->size())
+    std::swap(a, b);
+
+  for (auto&& item : a->items) {
+    if (!item.is_removed() && b->contains(item.key))
+      ret->insert(item.key->clone());
+  }
+
+  return ret;
+}
+
+//
+// a.difference(b)
+DEFINE_BUILTIN_FUNC(set_difference)
+{
+  auto a = (ObjSet*)args[0].object;
+  auto b = (ObjSet*)args[1].object;
+
+  auto ret = new ObjSet(a->type);
+
+  for (auto&& item : a->items) {
+    if (!item.is_removed() && !b->contains(item.key))
+      ret->insert(item.key->clone());
+  }
+
+  return ret;
+}
+
+//
+// vector<T>.to_set()
+DEFINE_BUILTIN_FUNC(to_set)
+{
+  auto vec = (ObjVector*)args[0].object;
+  auto ret = new ObjSet(TypeInfo(TYPE_Set, {vec->type.type_params[0]}));
+
+  for (size_t i = 0; i < vec->size(); i++) {
+    auto elem = vec->get_element(i);
+
+    // 列指向であれば新しく作られたものなので、そのまま使う
+    ret->insert(vec->is_columnar() ? elem : elem->clone());
+  }
+
+  return ret;
+}
+
+//
+// deque<T>
+//
+// push_*, pop_* は self を変更する (modify_self)
+static ObjDeque* expect_not_empty_deque(BuiltinFunc::ArgumentObject const& arg)
+{
+  auto deq = (ObjDeque*)arg.object;
+
+  if (deq->size() == 0)
+    Error(arg.ast, "deque is empty").emit().exit();
+
+  return deq;
+}
+
+DEFINE_BUILTIN_FUNC(deque_push_back)
+{
+  ((ObjDeque*)args[0].object)->push_back(stored_value(args[1]));
+
+  return new ObjNone;
+}
+
+DEFINE_BUILTIN_FUNC(deque_push_front)
+{
+  ((ObjDeque*)args[0].object)->push_front(stored_value(args[1]));
+
+  return new ObjNone;
+}
+
+DEFINE_BUILTIN_FUNC(deque_pop_back)
+{
+  return expect_not_empty_deque(args[0])->pop_back();
+}
+
+DEFINE_BUILTIN_FUNC(deque_pop_front)
+{
+  return expect_not_empty_deque(args[0])->pop_front();
+}
+
+DEFINE_BUILTIN_FUNC(deque_front)
+{
+  return expect_not_empty_deque(args[0])->at(0)->clone();
+}
+
+DEFINE_BUILTIN_FUNC(deque_back)
+{
+  auto deq = expect_not_empty_deque(args[0]);
+
+  return deq->at(deq->size() - 1)->clone();
+}
+
+DEFINE_BUILTIN_FUNC(deque_len)
+{
+  return new ObjLong(((ObjDeque*)args[0].object)->size());
+}
+
+//
+// 数値のベクタ (vector<int>, vector<float>)
+//
+// 要素は値の配列で持っているので、Kernel でまとめて処理する
+template <class T>
+static T const* vec_data(Object* obj)
+{
+  return ((ObjVector*)obj)->scalar_data<T>();
+}
+
+//
+// 内容を変更する場合 (共有している列はコピーされる)
+template <class T>
+static T* vec_mutable_data(Object* obj)
+{
+  return ((ObjVector*)obj)->mutable_scalar_data<T>();
+}
+
+static size_t vec_size(Object* obj)
+{
+  return ((ObjVector*)obj)->size();
+}
+
+static Object* make_number(int64_t value)
+{
+  return new ObjLong(value);
+}
+
+static Object* make_number(float value)
+{
+  return new ObjFloat(value);
+}
+
+template <class T>
+static T get_number(Object* obj)
+{
+  if constexpr (std::is_same_v<T, float>)
+    return ((ObjFloat*)obj)->value;
+  else
+    return ((ObjLong*)obj)->value;
+}
+
+static void expect_not_empty(BuiltinFunc::ArgumentObject const& arg)
+{
+  if (vec_size(arg.object) == 0)
+    Error(arg.ast, "vector is empty").emit().exit();
+}
+
+static void expect_same_size(BuiltinFunc::ArgumentVector const& args)
+{
+  if (vec_size(args[0].object) != vec_size(args[1].object))
+    Error(args[1].ast, "vector size mismatch").emit().exit();
+}
+
+template <class T>
+DEFINE_BUILTIN_FUNC(vec_sum)
+{
+  return make_number(
+    Kernel::sum(vec_data<T>(args[0].object), vec_size(args[0].object)));
+}
+
+template <class T>
+DEFINE_BUILTIN_FUNC(vec_min)
+{
+  expect_not_empty(args[0]);
+
+  return make_number(
+    Kernel::min(vec_data<T>(args[0].object), vec_size(args[0].object)));
+}
+
+template <class T>
+DEFINE_BUILTIN_FUNC(vec_max)
+{
+  expect_not_empty(args[0]);
+
+  return make_number(
+    Kernel::max(vec_data<T>(args[0].object), vec_size(args[0].object)));
+}
+
+template <class T>
+DEFINE_BUILTIN_FUNC(vec_dot)
+{
+  expect_same_size(args);
+
+  return make_number(Kernel::dot(vec_data<T>(args[0].object),
+                                 vec_data<T>(args[1].object),
+                                 vec_size(args[0].object)));
+}
+
+template <class T>
+DEFINE_BUILTIN_FUNC(vec_scale)
+{
+  Kernel::scale(vec_mutable_data<T>(args[0].object), vec_size(args[0].object),
+                get_number<T>(args[1].object));
+
+  return new ObjNone;
+}
+
+template <class T>
+DEFINE_BUILTIN_FUNC(vec_add)
+{
+  expect_same_size(args);
+
+  // 同じベクタの場合があるので、先にコピーを済ませておく
+  auto dest = vec_mutable_data<T>(args[0].object);
+
+  Kernel::add(dest, vec_data<T>(args[1].object), vec_size(args[0].object));
+
+  return new ObjNone;
+}
+
+template <class T>
+DEFINE_BUILTIN_FUNC(vec_fill)
+{
+  Kernel::fill(vec_mutable_data<T>(args[0].object), vec_size(args[0].object),
+               get_number<T>(args[1].object));
+
+  return new ObjNone;
+}
+
+template <class T>
+DEFINE_BUILTIN_FUNC(vec_count)
+{
+  return new ObjLong(Kernel::count(vec_data<T>(args[0].object),
+                                   vec_size(args[0].object),
+                                   get_number<T>(args[1].object)));
+}
+
+template <class T>
+DEFINE_BUILTIN_FUNC(vec_index_of)
+{
+  return new ObjLong(Kernel::index_of(vec_data<T>(args[0].object),
+                                      vec_size(args[0].object),
+                                      get_number<T>(args[1].object)));
+}
+
+//
+// 容量の管理
+//
+// 要素数が分かっている場合は、先に領域を確保しておくと
+// 追加のたびに作り直さずに済む
+
+//
+// 0 以上の整数の引数
+static size_t get_size_arg(BuiltinFunc::ArgumentObject const& arg)
+{
+  auto n = ((ObjLong*)arg.object)->value;
+
+  if (n < 0)
+    Error(arg.ast, "negative size").emit().exit();
+
+  return n;
+}
+
+//
+// 引数の型が self と同じであること
+static void expect_same_type(BuiltinFunc::ArgumentVector const& args)
+{
+  auto const& self = args[0].object->type;
+  auto const& type = args[1].object->type;
+
+  if (!type.equals(self))
+    Error(args[1].ast, "expected '" + self.to_string() + "' but found '" +
+                         type.to_string() + "'")
+      .emit()
+      .exit();
+}
+
+//
+// let x: T = with_capacity(n)
+//
+// args[0] は代入先の型で作成したオブジェクト (BuiltinFunc::use_expected_type)
+DEFINE_BUILTIN_FUNC(with_capacity)
+{
+  auto obj = args[0].object;
+  auto n = get_size_arg(args[1]);
+
+  switch (obj->type.kind) {
+    case TYPE_Vector:
+      ((ObjVector*)obj)->reserve(n);
+      break;
+
+    case TYPE_Dict:
+      ((ObjDict*)obj)->reserve(n);
+      break;
+
+    default:
+      panic("with_capacity");
+  }
+
+  return obj;
+}
+
+//
+// vector<T>.reserve(int)
+DEFINE_BUILTIN_FUNC(vec_reserve)
+{
+  ((ObjVector*)args[0].object)->reserve(get_size_arg(args[1]));
+
+  return new ObjNone;
+}
+
+//
+// vector<T>.extend(vector<T>)
+DEFINE_BUILTIN_FUNC(vec_extend)
+{
+  expect_same_type(args);
+
+  ((ObjVector*)args[0].object)->extend((ObjVector*)args[1].object);
+
+  return new ObjNone;
+}
+
+//
+// vector<T>.resize(int, T)
+DEFINE_BUILTIN_FUNC(vec_resize)
+{
+  ((ObjVector*)args[0].object)
+    ->resize(get_size_arg(args[1]), args[2].object);
+
+  return new ObjNone;
+}
+
+//
+// vector<T>.truncate(int)
+DEFINE_BUILTIN_FUNC(vec_truncate)
+{
+  ((ObjVector*)args[0].object)->truncate(get_size_arg(args[1]));
+
+  return new ObjNone;
+}
+
+//
+// vector<T>.shrink_to_fit()
+DEFINE_BUILTIN_FUNC(vec_shrink_to_fit)
+{
+  ((ObjVector*)args[0].object)->shrink_to_fit();
+
+  return new ObjNone;
+}
+
+//
+// dict<K, V>.reserve(int)
+DEFINE_BUILTIN_FUNC(dict_reserve)
+{
+  ((ObjDict*)args[0].object)->reserve(get_size_arg(args[1]));
+
+  return new ObjNone;
+}
+
+//
+// dict<K, V>.extend(dict<K, V>)
+DEFINE_BUILTIN_FUNC(dict_extend)
+{
+  expect_same_type(args);
+
+  ((ObjDict*)args[0].object)->extend((ObjDict*)args[1].object);
+
+  return new ObjNone;
+}
+
+//
+// dict<K, V>.shrink_to_fit()
+DEFINE_BUILTIN_FUNC(dict_shrink_to_fit)
+{
+  ((ObjDict*)args[0].object)->shrink_to_fit();
+
+  return new ObjNone;
+}
+
+//
+// 並べ替え・二分探索
+//
+// 値の配列を持つベクタは、その配列を直接並べ替える
+// それ以外は要素のポインタを Object::compare の順に並べ替える
+// 大きなベクタは複数のスレッドで並べ替える (Sort::parallel_sort)
+
+//
+// 要素の型に対応する C++ の型で Func<T>(Args...) を呼ぶ
+#define SCALAR_DISPATCH(Kind, Func, Args...) \
+  switch (Kind) {                            \
+    case TYPE_Int:                           \
+      return Func<int64_t>(Args);            \
+    case TYPE_USize:                         \
+      return Func<size_t>(Args);             \
+    case TYPE_Float:                         \
+      return Func<float>(Args);              \
+    case TYPE_Bool:                          \
+      return Func<bool>(Args);               \
+    case TYPE_Char:                          \
+      return Func<metro_char_t>(Args);       \
+  }
+
+//
+// NaN は最も大きいものとする (Object::compare と同じ)
+template <class T>
+static bool less_value(T a, T b)
+{
+  if constexpr (std::is_floating_point_v<T>) {
+    if (std::isnan(a) || std::isnan(b))
+      return !std::isnan(a) && std::isnan(b);
+  }
+
+  return a < b;
+}
+
+static bool less_object(Object* a, Object* b)
+{
+  return a->compare(b) < 0;
+}
+
+static void expect_comparable(BuiltinFunc::ArgumentObject const& arg)
+{
+  auto const& elem = arg.object->type.type_params[0];
+
+  if (!Object::is_comparable(elem.kind))
+    Error(arg.ast, "'" + elem.to_string() + "' is not comparable")
+      .emit()
+      .exit();
+}
+
+//
+// 比較の途中で平坦化 (変更) されないように、先に済ませておく
+static void flatten_strings(ObjVector* vec)
+{
+  for (auto&& e : vec->elements) {
+    if (e->type.kind == TYPE_String)
+      ((ObjString*)e)->view();
+  }
+}
+
+//
+// 値の配列は安定である必要がない (等しい値は区別できない)
+template <class T>
+static void sort_scalar(ObjVector* vec, bool desc)
+{
+  auto begin = vec->mutable_scalar_data<T>();
+  auto end = begin + vec->size();
+
+  // NaN を後ろに集めて、残りを普通に比較する
+  if constexpr (std::is_floating_point_v<T>)
+    end = std::partition(begin, end, [](T x) { return !std::isnan(x); });
+
+  Sort::parallel_sort(begin, end, std::less<T>(), false);
+
+  if (desc)
+    std::reverse(begin, begin + vec->size());
+}
+
+static void sort_scalar_vector(ObjVector* vec, bool desc)
+{
+  SCALAR_DISPATCH(vec->layout->fields[0].kind, sort_scalar, vec, desc);
+}
+
+static Object* sort_vector(BuiltinFunc::ArgumentVector const& args, bool desc,
+                           bool stable)
+{
+  auto vec = (ObjVector*)args[0].object;
+
+  expect_comparable(args[0]);
+
+  if (vec->is_scalar) {
+    sort_scalar_vector(vec, desc);
+    return new ObjNone;
+  }
+
+  flatten_strings(vec);
+
+  auto begin = vec->elements.data();
+  auto end = begin + vec->elements.size();
+
+  if (desc)
+    Sort::parallel_sort(
+      begin, end, [](Object* a, Object* b) { return less_object(b, a); },
+      stable);
+  else
+    Sort::parallel_sort(begin, end, less_object, stable);
+
+  return new ObjNone;
+}
+
+//
+// sort(), sort_desc(), stable_sort()
+DEFINE_BUILTIN_FUNC(sort)
+{
+  return sort_vector(args, false, false);
+}
+
+DEFINE_BUILTIN_FUNC(sort_desc)
+{
+  return sort_vector(args, true, false);
+}
+
+DEFINE_BUILTIN_FUNC(stable_sort)
+{
+  return sort_vector(args, false, true);
+}
+
+//
+// keys の値の順に並べた添字
+template <class T>
+static void sort_order(ObjVector* keys, std::vector<size_t>& order)
+{
+  auto p = keys->scalar_data<T>();
+
+  Sort::parallel_sort(
+    order.data(), order.data() + order.size(),
+    [p](size_t a, size_t b) { return less_value(p[a], p[b]); }, true);
+}
+
+static void sort_order_scalar(ObjVector* keys, std::vector<size_t>& order)
+{
+  SCALAR_DISPATCH(keys->layout->fields[0].kind, sort_order, keys, order);
+}
+
+//
+// sort_by_key(keys)
+// keys (同じ長さのベクタ) の値の順に並べ替える (安定)
+DEFINE_BUILTIN_FUNC(sort_by_key)
+{
+  auto vec = (ObjVector*)args[0].object;
+  auto keys = (ObjVector*)args[1].object;
+
+  expect_comparable(args[1]);
+
+  if (vec->size() != keys->size())
+    Error(args[1].ast, "vector size mismatch").emit().exit();
+
+  std::vector<size_t> order(vec->size());
+
+  std::iota(order.begin(), order.end(), 0);
+
+  if (keys->is_scalar) {
+    sort_order_scalar(keys, order);
+  }
+  else {
+    flatten_strings(keys);
+
+    Sort::parallel_sort(
+      order.data(), order.data() + order.size(),
+      [keys](size_t a, size_t b) {
+        return less_object(keys->elements[a], keys->elements[b]);
+      },
+      true);
+  }
+
+  vec->permute(order);
+
+  return new ObjNone;
+}
+
+template <class T>
+static int64_t search_scalar(ObjVector* vec, Object* value)
+{
+  T v;
+
+  Object::to_raw(vec->layout->fields[0].kind, &v, value);
+
+  auto begin = vec->scalar_data<T>();
+  auto end = begin + vec->size();
+  auto it = std::lower_bound(begin, end, v, less_value<T>);
+
+  return it != end && !less_value(v, *it) ? it - begin : -1;
+}
+
+static int64_t search_scalar_vector(ObjVector* vec, Object* value)
+{
+  SCALAR_DISPATCH(vec->layout->fields[0].kind, search_scalar, vec, value);
+
+  return -1;
+}
+
+//
+// binary_search(value)
+// 昇順に並んでいるベクタから探す
+// 見つからなければ -1
+DEFINE_BUILTIN_FUNC(binary_search)
+{
+  auto vec = (ObjVector*)args[0].object;
+  auto value = args[1].object;
+
+  expect_comparable(args[0]);
+
+  if (vec->is_scalar)
+    return new ObjLong(search_scalar_vector(vec, value));
+
+  auto begin = vec->elements.begin();
+  auto end = vec->elements.end();
+  auto it = std::lower_bound(begin, end, value, less_object);
+
+  return new ObjLong(it != end && !less_object(value, *it) ? it - begin : -1);
+}
+
+//
+// heap<T>
+//
+// 最小ヒープ (pop, peek は最も小さい要素)
+// push, pop は self を変更する (modify_self)
+static ObjHeap* expect_not_empty_heap(BuiltinFunc::ArgumentObject const& arg)
+{
+  auto heap = (ObjHeap*)arg.object;
+
+  if (heap->size() == 0)
+    Error(arg.ast, "heap is empty").emit().exit();
+
+  return heap;
+}
+
+DEFINE_BUILTIN_FUNC(heap_push)
+{
+  expect_comparable(args[0]);
+
+  ((ObjHeap*)args[0].object)->push(stored_value(args[1]));
+
+  return new ObjNone;
+}
+
+DEFINE_BUILTIN_FUNC(heap_pop)
+{
+  return expect_not_empty_heap(args[0])->pop();
+}
+
+DEFINE_BUILTIN_FUNC(heap_peek)
+{
+  return expect_not_empty_heap(args[0])->peek();
+}
+
+DEFINE_BUILTIN_FUNC(heap_len)
+{
+  return new ObjLong(((ObjHeap*)args[0].object)->size());
+}
+
+//
+// vector<T>.heapify()
+// 要素をすべて持つヒープを O(n) で作成する
+DEFINE_BUILTIN_FUNC(heapify)
+{
+  auto vec = (ObjVector*)args[0].object;
+
+  expect_comparable(args[0]);
+
+  auto ret = new ObjHeap(TypeInfo(TYPE_Heap, {vec->type.type_params[0]}));
+
+  ret->heapify(vec);
+
+  return ret;
+}
+
+//
+// pvector<T>
+//
+// push, pop は self を変更する (modify_self)
+// self の節は複製元と共有しているので、変更する経路だけがコピーされる
+DEFINE_BUILTIN_FUNC(pvec_push)
+{
+  ((ObjPVector*)args[0].object)->push(stored_value(args[1]));
+
+  return new ObjNone;
+}
+
+DEFINE_BUILTIN_FUNC(pvec_pop)
+{
+  auto vec = (ObjPVector*)args[0].object;
+
+  if (vec->size() == 0)
+    Error(args[0].ast, "pvector is empty").emit().exit();
+
+  return vec->pop();
+}
+
+DEFINE_BUILTIN_FUNC(pvec_len)
+{
+  return new ObjLong(((ObjPVector*)args[0].object)->size());
+}
+
+//
+// pvector<T>.to_vector()
+DEFINE_BUILTIN_FUNC(pvec_to_vector)
+{
+  auto vec = (ObjPVector*)args[0].object;
+  auto ret = new ObjVector(TypeInfo(TYPE_Vector, {vec->type.type_params[0]}));
+
+  ret->reserve(vec->size());
+
+  for (size_t i = 0; i < vec->size(); i++)
+    ret->append(vec->get(i)->clone());
+
+  return ret;
+}
+
+//
+// vector<T>.to_pvector()
+DEFINE_BUILTIN_FUNC(to_pvector)
+{
+  auto vec = (ObjVector*)args[0].object;
+  auto ret = new ObjPVector(TypeInfo(TYPE_PVector, {vec->type.type_params[0]}));
+
+  for (size_t i = 0; i < vec->size(); i++) {
+    auto elem = vec->get_element(i);
+
+    // 列指向であれば新しく作られたものなので、そのまま使う
+    ret->push(vec->is_columnar() ? elem : elem->clone());
+  }
+
+  return ret;
+}
+
+//
+// pdict<K, V>
+//
+// remove は self を変更する (modify_self)
+DEFINE_BUILTIN_FUNC(pdict_get)
+{
+  auto value = ((ObjPDict*)args[0].object)->find(args[1].object);
+
+  return value ? value->clone() : stored_value(args[2]);
+}
+
+DEFINE_BUILTIN_FUNC(pdict_contains)
+{
+  return new ObjBool(((ObjPDict*)args[0].object)->find(args[1].object));
+}
+
+DEFINE_BUILTIN_FUNC(pdict_remove)
+{
+  return new ObjBool(((ObjPDict*)args[0].object)->remove(args[1].object));
+}
+
+DEFINE_BUILTIN_FUNC(pdict_len)
+{
+  return new ObjLong(((ObjPDict*)args[0].object)->size());
+}
+
+//
+// bitset
+//
+// set, clear, resize と and, or, xor, not は self を変更する (modify_self)
+static ObjBitset* bitset_of(BuiltinFunc::ArgumentObject const& arg)
+{
+  return (ObjBitset*)arg.object;
+}
+
+DEFINE_BUILTIN_FUNC(bitset_set)
+{
+  bitset_of(args[0])->set(get_size_arg(args[1]));
+
+  return new ObjNone;
+}
+
+DEFINE_BUILTIN_FUNC(bitset_clear)
+{
+  bitset_of(args[0])->clear(get_size_arg(args[1]));
+
+  return new ObjNone;
+}
+
+//
+// test(i)
+// 範囲の外は false
+DEFINE_BUILTIN_FUNC(bitset_test)
+{
+  return new ObjBool(bitset_of(args[0])->test(get_size_arg(args[1])));
+}
+
+DEFINE_BUILTIN_FUNC(bitset_count)
+{
+  return new ObjLong(bitset_of(args[0])->count());
+}
+
+DEFINE_BUILTIN_FUNC(bitset_len)
+{
+  return new ObjLong(bitset_of(args[0])->size());
+}
+
+DEFINE_BUILTIN_FUNC(bitset_resize)
+{
+  bitset_of(args[0])->resize(get_size_arg(args[1]));
+
+  return new ObjNone;
+}
+
+DEFINE_BUILTIN_FUNC(bitset_and)
+{
+  bitset_of(args[0])->bit_and(bitset_of(args[1]));
+
+  return new ObjNone;
+}
+
+DEFINE_BUILTIN_FUNC(bitset_or)
+{
+  bitset_of(args[0])->bit_or(bitset_of(args[1]));
+
+  return new ObjNone;
+}
+
+DEFINE_BUILTIN_FUNC(bitset_xor)
+{
+  bitset_of(args[0])->bit_xor(bitset_of(args[1]));
+
+  return new ObjNone;
+}
+
+DEFINE_BUILTIN_FUNC(bitset_not)
+{
+  bitset_of(args[0])->flip();
+
+  return new ObjNone;
+}
+
+//
+// n 次元配列 (ndarray<int>, ndarray<float>)
+//
+// 計算は連続した値の配列に対して行う
+// ビュー (転置したものなど) は、先に連続した領域にコピーする
+static ObjNdArray* ndarray_of(BuiltinFunc::ArgumentObject const& arg)
+{
+  return (ObjNdArray*)arg.object;
+}
+
+//
+// 連続した複製 (元のものは変更しない)
+static ObjNdArray* contiguous_copy(ObjNdArray const* arr)
+{
+  auto ret = arr->clone();
+
+  ret->make_contiguous();
+
+  return ret;
+}
+
+//
+// vector<int> の引数を、各軸の大きさとして読む
+// 要素数が size であること
+static std::vector<size_t> get_shape_arg(BuiltinFunc::ArgumentObject const& arg,
+                                         size_t size)
+{
+  auto vec = (ObjVector*)arg.object;
+  auto p = vec->scalar_data<int64_t>();
+
+  std::vector<size_t> shape;
+  size_t n = 1;
+
+  for (size_t i = 0; i < vec->size(); i++) {
+    if (p[i] < 0)
+      Error(arg.ast, "negative size").emit().exit();
+
+    shape.emplace_back(p[i]);
+    n *= p[i];
+  }
+
+  if (n != size)
+    Error(arg.ast, "cannot reshape " + std::to_string(size) +
+                     " elements into " + vec->to_string())
+      .emit()
+      .exit();
+
+  return shape;
+}
+
+static size_t get_axis_arg(ObjNdArray const* arr,
+                           BuiltinFunc::ArgumentObject const& arg)
+{
+  auto axis = ((ObjLong*)arg.object)->value;
+
+  if (axis < 0 || (size_t)axis >= arr->ndim())
+    Error(arg.ast, "axis out of range").emit().exit();
+
+  return axis;
+}
+
+static void expect_not_empty_ndarray(BuiltinFunc::ArgumentObject const& arg)
+{
+  if (ndarray_of(arg)->size() == 0)
+    Error(arg.ast, "ndarray is empty").emit().exit();
+}
+
+//
+// vector<T>.reshape(shape)
+template <class T>
+DEFINE_BUILTIN_FUNC(vec_reshape)
+{
+  auto vec = (ObjVector*)args[0].object;
+  auto col = vec->column_view(0);
+
+  auto ret = ObjNdArray::create(vec->type.type_params[0].kind,
+                                get_shape_arg(args[1], vec->size()));
+
+  std::memcpy(ret->mutable_data<T>(), col.data(), col.size());
+
+  return ret;
+}
+
+//
+// ndarray<T>.reshape(shape)
+DEFINE_BUILTIN_FUNC(nd_reshape)
+{
+  auto arr = ndarray_of(args[0]);
+
+  return arr->reshape(get_shape_arg(args[1], arr->size()));
+}
+
+DEFINE_BUILTIN_FUNC(nd_shape)
+{
+  auto ret = new ObjVector(TypeInfo(TYPE_Vector, {TYPE_Int}));
+
+  for (auto&& x : ndarray_of(args[0])->shape)
+    ret->append(new ObjLong(x));
+
+  return ret;
+}
+
+//
+// 行優先の順に並べたベクタ
+template <class T>
+DEFINE_BUILTIN_FUNC(nd_to_vector)
+{
+  auto arr = contiguous_copy(ndarray_of(args[0]));
+  auto ret = new ObjVector(TypeInfo(TYPE_Vector, {arr->elem_kind()}));
+
+  ret->resize(arr->size(), make_number(T{}));
 
-namespace builtin {
+  std::copy_n(arr->data<T>(), arr->size(), ret->mutable_scalar_data<T>());
 
-DEFINE_BUILTIN_FUNC(print)
+  return ret;
+}
+
+//
+// 軸の順序を逆にしたビュー (コピーしない)
+DEFINE_BUILTIN_FUNC(nd_transpose)
 {
-  size_t len = 0;
+  return ndarray_of(args[0])->transpose();
+}
 
-  for (auto&& arg : args) {
-    auto s = arg.object->to_string();
+//
+// 全体の合計・最小・最大
+template <class T>
+DEFINE_BUILTIN_FUNC(nd_sum)
+{
+  auto arr = contiguous_copy(ndarray_of(args[0]));
 
-    std::cout << s;
+  return make_number(Kernel::sum(arr->data<T>(), arr->size()));
+}
 
-    len += s.length();
-  }
+template <class T>
+DEFINE_BUILTIN_FUNC(nd_min)
+{
+  expect_not_empty_ndarray(args[0]);
 
-  return new ObjLong(len);
+  auto arr = contiguous_copy(ndarray_of(args[0]));
+
+  return make_number(Kernel::min(arr->data<T>(), arr->size()));
 }
 
-DEFINE_BUILTIN_FUNC(println)
+template <class T>
+DEFINE_BUILTIN_FUNC(nd_max)
 {
-  auto ret = print(args);
+  expect_not_empty_ndarray(args[0]);
 
-  std::cout << "\n";
-  ((ObjLong*)ret)->value += 1;
+  auto arr = contiguous_copy(ndarray_of(args[0]));
 
-  return ret;
+  return make_number(Kernel::max(arr->data<T>(), arr->size()));
 }
 
 //
-// id(T)
-DEFINE_BUILTIN_FUNC(id)
+// axis 番目の軸に沿って畳み込む
+// 結果はその軸を除いた形になる
+//
+// 手前の軸 (outer) ごとに、axis の各位置の行 (inner 個の連続した値) を
+// 順に op で足し込んでいくので、読み書きはいずれも連続する
+template <class T, class Op>
+static ObjNdArray* reduce_axis(BuiltinFunc::ArgumentVector const& args, Op op)
 {
-  return ObjString::from_u8_string(Utils::format("%p", args[0]));
+  auto arr = contiguous_copy(ndarray_of(args[0]));
+  auto axis = get_axis_arg(arr, args[1]);
+
+  size_t outer = 1, inner = 1, n = arr->shape[axis];
+
+  for (size_t i = 0; i < axis; i++)
+    outer *= arr->shape[i];
+
+  for (size_t i = axis + 1; i < arr->ndim(); i++)
+    inner *= arr->shape[i];
+
+  auto shape = arr->shape;
+
+  shape.erase(shape.begin() + axis);
+
+  auto ret = ObjNdArray::create(arr->elem_kind(), shape);
+
+  if (n == 0)
+    return ret;
+
+  auto src = arr->data<T>();
+  auto dest = ret->mutable_data<T>();
+
+  for (size_t o = 0; o < outer; o++) {
+    auto out = dest + o * inner;
+    auto row = src + o * n * inner;
+
+    std::copy_n(row, inner, out);
+
+    for (size_t j = 1; j < n; j++)
+      for (size_t i = 0; i < inner; i++)
+        out[i] = op(out[i], row[j * inner + i]);
+  }
+
+  return ret;
 }
 
-//
-// type(T)
-DEFINE_BUILTIN_FUNC(type)
+template <class T>
+DEFINE_BUILTIN_FUNC(nd_sum_axis)
 {
-  return ObjString::from_u8_string(args[0].object->type.to_string());
+  return reduce_axis<T>(args, std::plus<T>());
 }
 
-//
-// to_string(T)
-DEFINE_BUILTIN_FUNC(to_string)
+template <class T>
+DEFINE_BUILTIN_FUNC(nd_min_axis)
 {
-  return ObjString::from_u8_string(args[0].object->to_string());
+  expect_not_empty_ndarray(args[0]);
+
+  return reduce_axis<T>(args, [](T a, T b) { return std::min(a, b); });
 }
 
-//
-// length(string)
-DEFINE_BUILTIN_FUNC(length)
+template <class T>
+DEFINE_BUILTIN_FUNC(nd_max_axis)
 {
-  return new ObjUSize(((ObjString*)args[0].object)->characters.size());
+  expect_not_empty_ndarray(args[0]);
+
+  return reduce_axis<T>(args, [](T a, T b) { return std::max(a, b); });
 }
 
 //
-// push(vector<T>)
-DEFINE_BUILTIN_FUNC(push)
+// a.matmul(b)
+// 2 次元の配列どうしの積
+template <class T>
+DEFINE_BUILTIN_FUNC(nd_matmul)
 {
-  return ((ObjVector*)args[0].object)->append(args[1].object);
+  auto a = contiguous_copy(ndarray_of(args[0]));
+  auto b = contiguous_copy(ndarray_of(args[1]));
+
+  if (a->ndim() != 2)
+    Error(args[0].ast, "expected 2-dimensional ndarray").emit().exit();
+
+  if (b->ndim() != 2)
+    Error(args[1].ast, "expected 2-dimensional ndarray").emit().exit();
+
+  if (a->shape[1] != b->shape[0])
+    Error(args[1].ast, "shape mismatch").emit().exit();
+
+  auto n = a->shape[0];
+  auto k = a->shape[1];
+  auto m = b->shape[1];
+
+  auto ret = ObjNdArray::create(a->elem_kind(), {n, m});
+
+  Kernel::matmul(a->data<T>(), b->data<T>(), ret->mutable_data<T>(), n, k, m);
+
+  return ret;
 }
 
 //
-// substr
+// substr(pos), substr(pos, len)
+// pos 以降の (最大 len 文字の) 部分文字列
 DEFINE_BUILTIN_FUNC(substr)
 {
-  return ObjString::from_u8_string(args[0].object->to_string());
+  auto str = (ObjString*)args[0].object;
+  auto pos = ((ObjLong*)args[1].object)->value;
+
+  if (pos < 0 || (size_t)pos > str->length())
+    Error(args[1].ast, "index out of range").emit().exit();
+
+  auto end = str->length();
+
+  if (args.size() >= 3) {
+    auto len = ((ObjLong*)args[2].object)->value;
+
+    if (len < 0)
+      Error(args[2].ast, "negative length").emit().exit();
+
+    end = std::min(end, (size_t)pos + (size_t)len);
+  }
+
+  return str->slice(pos, end);
+}
+
+//
+// str の pos 以降から sub を探す
+static int64_t find_string(std::u16string_view str, std::u16string_view sub,
+                           size_t pos)
+{
+  if (pos > str.length())
+    return -1;
+
+  auto found = Kernel::find(str.data() + pos, str.length() - pos, sub.data(),
+                            sub.length());
+
+  return found < 0 ? -1 : found + (int64_t)pos;
 }
 
 //
@@ -100,60 +1293,117 @@ DEFINE_BUILTIN_FUNC(substr)
 DEFINE_BUILTIN_FUNC(replace)
 {
   auto str = (ObjString*)args[0].object;
-  auto _from = (ObjString*)args[1].object;
-  auto _to = (ObjString*)args[2].object;
 
-  size_t fromLen = _from->length();
-  size_t toLen = _to->length();
+  auto src = str->view();
+  auto from = ((ObjString*)args[1].object)->view();
+  auto to = ((ObjString*)args[2].object)->view();
 
-  if (str->length() < fromLen) {
-    return str;
-  }
+  // self は変更せず、新しい文字列を返す
+  if (from.empty())
+    return str->clone();
 
-  std::vector<size_t> posv;
+  auto found = find_string(src, from, 0);
 
-  for (size_t i = 0, end = str->length() - fromLen; i < end;) {
-    for (size_t j = 0; j < fromLen; j++) {
-      if (str->characters[i + j]->value != _from->characters[j]->value)
-        goto not_eq_L;
+  if (found < 0)
+    return str->clone();
+
+  //
+  // 一度だけ走査して、結果を作る
+  metro_string_t result;
+
+  result.reserve(src.length());
+
+  for (size_t pos = 0;;) {
+    if (found < 0) {
+      result.append(src, pos);
+      break;
     }
 
-    posv.emplace_back(i);
-    i += fromLen;
-    continue;
+    result.append(src, pos, found - pos);
+    result += to;
 
-  not_eq_L:
-    i++;
+    pos = found + from.length();
+    found = find_string(src, from, pos);
   }
 
-  if (fromLen == toLen) {
-    for (auto&& pos : posv) {
-      for (size_t i = 0; i < fromLen; i++) {
-        str->characters[pos + i]->value = _to->characters[i]->value;
-      }
-    }
+  return new ObjString(std::move(result));
+}
+
+//
+// string.find(string)
+//
+// 見つからなければ -1
+DEFINE_BUILTIN_FUNC(find)
+{
+  return new ObjLong(find_string(((ObjString*)args[0].object)->view(),
+                                 ((ObjString*)args[1].object)->view(), 0));
+}
+
+//
+// string.contains(string)
+DEFINE_BUILTIN_FUNC(contains)
+{
+  return new ObjBool(
+    find_string(((ObjString*)args[0].object)->view(),
+                ((ObjString*)args[1].object)->view(), 0) >= 0);
+}
+
+//
+// string.count(string)
+//
+// 重ならない出現回数を数える
+DEFINE_BUILTIN_FUNC(count)
+{
+  auto str = ((ObjString*)args[0].object)->view();
+  auto sub = ((ObjString*)args[1].object)->view();
 
-    return str;
+  int64_t count = 0;
+
+  if (!sub.empty()) {
+    for (auto pos = find_string(str, sub, 0); pos >= 0;
+         pos = find_string(str, sub, pos + sub.length()))
+      count++;
   }
 
-  bool b = fromLen < toLen;
-  size_t diff = b ? toLen - fromLen : fromLen - toLen;
+  return new ObjLong(count);
+}
+
+//
+// string.split(string)
+DEFINE_BUILTIN_FUNC(split)
+{
+  auto str = ((ObjString*)args[0].object)->view();
+  auto sep = ((ObjString*)args[1].object)->view();
 
-  for (auto&& pos : posv) {
-    for (size_t i = 0; i < diff; i++) {
-      if (b)
-        str->characters.insert(str->characters.begin() + pos + i,
-                               _to->characters[i]->clone());
-      else
-        str->characters.erase(str->characters.begin() + pos);
-    }
+  if (sep.empty())
+    Error(args[1].ast, "empty separator").emit().exit();
 
-    for (size_t i = b ? diff : 0; i < toLen; i++) {
-      str->characters[pos + i]->value = _to->characters[i]->value;
+  auto ret = new ObjVector(TypeInfo(TYPE_Vector, {TYPE_String}));
+
+  for (size_t pos = 0;;) {
+    auto found = find_string(str, sep, pos);
+
+    if (found < 0) {
+      ret->append(new ObjString(metro_string_t(str.substr(pos))));
+      break;
     }
+
+    ret->append(
+      new ObjString(metro_string_t(str.substr(pos, found - pos))));
+    pos = found + sep.length();
   }
 
-  return str;
+  return ret;
+}
+
+//
+// intern(string)
+//
+// 文字列を登録する
+// 登録された文字列どうしの比較はポインタの比較になる
+DEFINE_BUILTIN_FUNC(intern)
+{
+  return ((ObjString*)args[0].object)->intern();
 }
 
 //
@@ -184,26 +1434,196 @@ DEFINE_BUILTIN_FUNC(open)
       .exit();
   }
 
-  ObjString* ret = new ObjString();
+  // まとめて読み込んで、一度に変換する
+  std::string data{std::istreambuf_iterator<char>(ifs),
+                   std::istreambuf_iterator<char>()};
+
+  // 最後の行にも改行をつける
+  if (!data.empty() && data.back() != '\n')
+    data += '\n';
+
+  return new ObjString(metro_string_t::from_utf8(data));
+}
+
+//
+// validate_utf8(string)
+// UTF-8 に変換できるか (対になっていないサロゲートを含まないか)
+DEFINE_BUILTIN_FUNC(validate_utf8)
+{
+  auto str = ((ObjString*)args[0].object)->view();
+
+  return new ObjBool(Kernel::is_well_formed(str.data(), str.length()));
+}
+
+//
+// byte_len(string)
+// UTF-8 に変換したときのバイト数
+DEFINE_BUILTIN_FUNC(byte_len)
+{
+  auto str = ((ObjString*)args[0].object)->view();
+
+  return new ObjLong(Kernel::utf8_length(str.data(), str.length()));
+}
+
+//
+// exit(), exit(code)
+DEFINE_BUILTIN_FUNC(exit)
+{
+  Heap::dump_on_exit();
+
+  std::exit(args.empty() ? 0 : (int)((ObjLong*)args[0].object)->value);
+}
+
+//
+// StringBuilder
+//
+// self は変数そのものが渡される (modify_self)
+static metro_string_t& builder_buffer(Object* obj)
+{
+  return ((ObjStringBuilder*)obj)->buffer;
+}
+
+//
+// push(char)
+DEFINE_BUILTIN_FUNC(builder_push)
+{
+  builder_buffer(args[0].object) += ((ObjChar*)args[1].object)->value;
+
+  return new ObjNone;
+}
+
+//
+// push_str(string)
+DEFINE_BUILTIN_FUNC(builder_push_str)
+{
+  ((ObjString*)args[1].object)->append_to(builder_buffer(args[0].object));
+
+  return new ObjNone;
+}
+
+//
+// push_int(int)
+DEFINE_BUILTIN_FUNC(builder_push_int)
+{
+  char buf[32];
+
+  auto end =
+    std::to_chars(buf, buf + sizeof(buf), ((ObjLong*)args[1].object)->value)
+      .ptr;
+
+  builder_buffer(args[0].object).append(buf, end);
+
+  return new ObjNone;
+}
+
+//
+// reserve(int)
+DEFINE_BUILTIN_FUNC(builder_reserve)
+{
+  auto n = ((ObjLong*)args[1].object)->value;
+
+  if (n < 0)
+    Error(args[1].ast, "negative capacity").emit().exit();
+
+  builder_buffer(args[0].object).reserve(n);
+
+  return new ObjNone;
+}
+
+//
+// len()
+DEFINE_BUILTIN_FUNC(builder_len)
+{
+  return new ObjLong(builder_buffer(args[0].object).length());
+}
+
+//
+// build()
+// 中身を文字列に移す (コピーしない)
+DEFINE_BUILTIN_FUNC(builder_build)
+{
+  return ((ObjStringBuilder*)args[0].object)->build();
+}
+
+//
+// heap_stats
+//
+// オブジェクトの確保量を辞書で返す
+//   current, peak, count, limit : 全体
+//   bytes.<type>, count.<type>  : 型ごと (使用中のもののみ)
+DEFINE_BUILTIN_FUNC(heap_stats)
+{
+  (void)args;
+
+  std::vector<std::pair<std::string, int64_t>> stats{
+    {"current", Heap::get_current()},
+    {"peak", Heap::get_peak()},
+    {"count", Heap::get_count()},
+    {"limit", Heap::get_limit()},
+  };
+
+  auto kinds = TypeInfo::get_kind_and_names();
+
+  kinds.emplace_back(TYPE_UserDef, "struct");
 
-  std::string line;
+  for (auto&& [kind, name] : kinds) {
+    auto const& usage = Heap::get_usage(kind);
 
-  while (std::getline(ifs, line)) {
-    ret->append(Utils::String::to_wstr(line + '\n'));
+    if (usage.count == 0)
+      continue;
+
+    stats.emplace_back(std::string("bytes.") + name, usage.bytes);
+    stats.emplace_back(std::string("count.") + name, usage.count);
   }
 
+  auto ret = new ObjDict;
+
+  ret->type = TypeInfo(TYPE_Dict, {TYPE_String, TYPE_Int});
+
+  for (auto&& [key, value] : stats)
+    ret->append(ObjString::from_u8_string(key), new ObjLong(value));
+
   return ret;
 }
 
 //
-// exit
-DEFINE_BUILTIN_FUNC(exit)
+// dump_heap(path)
+//
+// 生存しているオブジェクトを書き出す (--heap-dump と同じ形式)
+DEFINE_BUILTIN_FUNC(dump_heap)
 {
-  std::exit((int)((ObjLong*)args[0].object)->value);
+  return new ObjBool(Heap::dump(((ObjString*)args[0].object)->to_string()));
 }
 
 }  // namespace builtin
 
+static TypeInfo const VecInt = TypeInfo(TYPE_Vector, {TYPE_Int});
+static TypeInfo const VecFloat = TypeInfo(TYPE_Vector, {TYPE_Float});
+
+static TypeInfo const SetOfT = TypeInfo(TYPE_Set, {TYPE_Template});
+
+static TypeInfo const DequeOfT = TypeInfo(TYPE_Deque, {TYPE_Template});
+
+static TypeInfo const HeapOfT = TypeInfo(TYPE_Heap, {TYPE_Template});
+
+static TypeInfo const NdInt = TypeInfo(TYPE_NdArray, {TYPE_Int});
+static TypeInfo const NdFloat = TypeInfo(TYPE_NdArray, {TYPE_Float});
+static TypeInfo const NdOfT = TypeInfo(TYPE_NdArray, {TYPE_Template});
+
+static TypeInfo const PVecOfT = TypeInfo(TYPE_PVector, {TYPE_Template});
+static TypeInfo const PDictOfT =
+  TypeInfo(TYPE_PDict, {TYPE_Template, TYPE_Template});
+
+static TypeInfo same_as_self(TypeInfo const& self)
+{
+  return self;
+}
+
+static TypeInfo element_of_self(TypeInfo const& self)
+{
+  return self.type_params[0];
+}
+
 static std::vector<BuiltinFunc> const _builtin_functions{
   BUILTIN_FUNC("print", builtin::print, TYPE_Int, TYPE_Args),
   BUILTIN_FUNC("println", builtin::println, TYPE_Int, TYPE_Args),
@@ -216,21 +1636,492 @@ static std::vector<BuiltinFunc> const _builtin_functions{
 
   BUILTIN_FUNC("length", builtin::length, TYPE_Int, TYPE_String),
 
-  BUILTIN_FUNC_FULL("push", builtin::push, true, true,
-                    TypeInfo(TYPE_Vector, {TYPE_Template}), TYPE_None, {},
+  BUILTIN_FUNC_MODIFY_SELF("push", builtin::push, true,
+                           TypeInfo(TYPE_Vector, {TYPE_Template}), TYPE_None,
+                           TYPE_Template),
+
+  BuiltinFunc{
+    .name = "get",
+    .is_template = true,
+    .have_self = true,
+    .self_type = TypeInfo(TYPE_Dict, {TYPE_Template, TYPE_Template}),
+    .result_type = TYPE_Template,
+    .arg_types{TYPE_Template, TYPE_Template},
+    .impl = builtin::dict_get,
+    .borrow_self = true,
+    .result_type_of = [](TypeInfo const& self) { return self.type_params[1]; },
+  },
+
+  BUILTIN_FUNC_FULL("contains", builtin::dict_contains, true, true,
+                    TypeInfo(TYPE_Dict, {TYPE_Template, TYPE_Template}),
+                    TYPE_Bool, TYPE_Template),
+
+  BUILTIN_FUNC_MODIFY_SELF("remove", builtin::dict_remove, true,
+                           TypeInfo(TYPE_Dict, {TYPE_Template, TYPE_Template}),
+                           TYPE_Bool, TYPE_Template),
+
+  //
+  // vector<int>, vector<float>
+  BUILTIN_FUNC_FULL("sum", builtin::vec_sum<int64_t>, false, true, VecInt,
+                    TYPE_Int),
+  BUILTIN_FUNC_FULL("sum", builtin::vec_sum<float>, false, true, VecFloat,
+                    TYPE_Float),
+
+  BUILTIN_FUNC_FULL("min", builtin::vec_min<int64_t>, false, true, VecInt,
+                    TYPE_Int),
+  BUILTIN_FUNC_FULL("min", builtin::vec_min<float>, false, true, VecFloat,
+                    TYPE_Float),
+
+  BUILTIN_FUNC_FULL("max", builtin::vec_max<int64_t>, false, true, VecInt,
+                    TYPE_Int),
+  BUILTIN_FUNC_FULL("max", builtin::vec_max<float>, false, true, VecFloat,
+                    TYPE_Float),
+
+  BUILTIN_FUNC_FULL("dot", builtin::vec_dot<int64_t>, false, true, VecInt,
+                    TYPE_Int, VecInt),
+  BUILTIN_FUNC_FULL("dot", builtin::vec_dot<float>, false, true, VecFloat,
+                    TYPE_Float, VecFloat),
+
+  BUILTIN_FUNC_MODIFY_SELF("insert", builtin::set_insert, true, SetOfT,
+                           TYPE_Bool, TYPE_Template),
+  BUILTIN_FUNC_FULL("contains", builtin::set_contains, true, true, SetOfT,
+                    TYPE_Bool, TYPE_Template),
+  BUILTIN_FUNC_MODIFY_SELF("remove", builtin::set_remove, true, SetOfT,
+                           TYPE_Bool, TYPE_Template),
+  BUILTIN_FUNC_FULL("len", builtin::set_len, true, true, SetOfT, TYPE_Int),
+
+  BuiltinFunc{
+    .name = "union",
+    .is_template = true,
+    .have_self = true,
+    .self_type = SetOfT,
+    .result_type = SetOfT,
+    .arg_types{SetOfT},
+    .impl = builtin::set_union,
+    .borrow_self = true,
+    .result_type_of = same_as_self,
+  },
+
+  BuiltinFunc{
+    .name = "intersection",
+    .is_template = true,
+    .have_self = true,
+    .self_type = SetOfT,
+    .result_type = SetOfT,
+    .arg_types{SetOfT},
+    .impl = builtin::set_intersection,
+    .borrow_self = true,
+    .result_type_of = same_as_self,
+  },
+
+  BuiltinFunc{
+    .name = "difference",
+    .is_template = true,
+    .have_self = true,
+    .self_type = SetOfT,
+    .result_type = SetOfT,
+    .arg_types{SetOfT},
+    .impl = builtin::set_difference,
+    .borrow_self = true,
+    .result_type_of = same_as_self,
+  },
+
+  BuiltinFunc{
+    .name = "to_set",
+    .is_template = true,
+    .have_self = true,
+    .self_type = TypeInfo(TYPE_Vector, {TYPE_Template}),
+    .result_type = SetOfT,
+    .arg_types{},
+    .impl = builtin::to_set,
+    .borrow_self = true,
+    .result_type_of =
+      [](TypeInfo const& self) {
+        return TypeInfo(TYPE_Set, {self.type_params[0]});
+      },
+  },
+
+  BuiltinFunc{
+    .name = "with_capacity",
+    .is_template = true,
+    .have_self = false,
+    .self_type = {},
+    .result_type = TYPE_Template,
+    .arg_types{TYPE_Int},
+    .impl = builtin::with_capacity,
+    .use_expected_type = true,
+  },
+
+  BUILTIN_FUNC_MODIFY_SELF("reserve", builtin::vec_reserve, true,
+                           TypeInfo(TYPE_Vector, {TYPE_Template}), TYPE_None,
+                           TYPE_Int),
+  BUILTIN_FUNC_MODIFY_SELF("extend", builtin::vec_extend, true,
+                           TypeInfo(TYPE_Vector, {TYPE_Template}), TYPE_None,
+                           TypeInfo(TYPE_Vector, {TYPE_Template})),
+  BUILTIN_FUNC_MODIFY_SELF("resize", builtin::vec_resize, true,
+                           TypeInfo(TYPE_Vector, {TYPE_Template}), TYPE_None,
+                           TYPE_Int, TYPE_Template),
+  BUILTIN_FUNC_MODIFY_SELF("truncate", builtin::vec_truncate, true,
+                           TypeInfo(TYPE_Vector, {TYPE_Template}), TYPE_None,
+                           TYPE_Int),
+  BUILTIN_FUNC_MODIFY_SELF("shrink_to_fit", builtin::vec_shrink_to_fit, true,
+                           TypeInfo(TYPE_Vector, {TYPE_Template}), TYPE_None),
+
+  BUILTIN_FUNC_MODIFY_SELF("reserve", builtin::dict_reserve, true,
+                           TypeInfo(TYPE_Dict, {TYPE_Template, TYPE_Template}),
+                           TYPE_None, TYPE_Int),
+  BUILTIN_FUNC_MODIFY_SELF("extend", builtin::dict_extend, true,
+                           TypeInfo(TYPE_Dict, {TYPE_Template, TYPE_Template}),
+                           TYPE_None,
+                           TypeInfo(TYPE_Dict, {TYPE_Template, TYPE_Template})),
+  BUILTIN_FUNC_MODIFY_SELF("shrink_to_fit", builtin::dict_shrink_to_fit, true,
+                           TypeInfo(TYPE_Dict, {TYPE_Template, TYPE_Template}),
+                           TYPE_None),
+
+  BUILTIN_FUNC_MODIFY_SELF("push_back", builtin::deque_push_back, true,
+                           DequeOfT, TYPE_None, TYPE_Template),
+  BUILTIN_FUNC_MODIFY_SELF("push_front", builtin::deque_push_front, true,
+                           DequeOfT, TYPE_None, TYPE_Template),
+
+  BuiltinFunc{
+    .name = "pop_back",
+    .is_template = true,
+    .have_self = true,
+    .self_type = DequeOfT,
+    .result_type = TYPE_Template,
+    .arg_types{},
+    .impl = builtin::deque_pop_back,
+    .modify_self = true,
+    .result_type_of = element_of_self,
+  },
+
+  BuiltinFunc{
+    .name = "pop_front",
+    .is_template = true,
+    .have_self = true,
+    .self_type = DequeOfT,
+    .result_type = TYPE_Template,
+    .arg_types{},
+    .impl = builtin::deque_pop_front,
+    .modify_self = true,
+    .result_type_of = element_of_self,
+  },
+
+  BuiltinFunc{
+    .name = "front",
+    .is_template = true,
+    .have_self = true,
+    .self_type = DequeOfT,
+    .result_type = TYPE_Template,
+    .arg_types{},
+    .impl = builtin::deque_front,
+    .borrow_self = true,
+    .result_type_of = element_of_self,
+  },
+
+  BuiltinFunc{
+    .name = "back",
+    .is_template = true,
+    .have_self = true,
+    .self_type = DequeOfT,
+    .result_type = TYPE_Template,
+    .arg_types{},
+    .impl = builtin::deque_back,
+    .borrow_self = true,
+    .result_type_of = element_of_self,
+  },
+
+  BUILTIN_FUNC_FULL("len", builtin::deque_len, true, true, DequeOfT,
+                    TYPE_Int),
+
+  BUILTIN_FUNC_MODIFY_SELF("push", builtin::heap_push, true, HeapOfT,
+                           TYPE_None, TYPE_Template),
+
+  BuiltinFunc{
+    .name = "pop",
+    .is_template = true,
+    .have_self = true,
+    .self_type = HeapOfT,
+    .result_type = TYPE_Template,
+    .arg_types{},
+    .impl = builtin::heap_pop,
+    .modify_self = true,
+    .result_type_of = element_of_self,
+  },
+
+  BuiltinFunc{
+    .name = "peek",
+    .is_template = true,
+    .have_self = true,
+    .self_type = HeapOfT,
+    .result_type = TYPE_Template,
+    .arg_types{},
+    .impl = builtin::heap_peek,
+    .borrow_self = true,
+    .result_type_of = element_of_self,
+  },
+
+  BUILTIN_FUNC_FULL("len", builtin::heap_len, true, true, HeapOfT, TYPE_Int),
+
+  BUILTIN_FUNC_MODIFY_SELF("push", builtin::pvec_push, true, PVecOfT,
+                           TYPE_None, TYPE_Template),
+
+  BuiltinFunc{
+    .name = "pop",
+    .is_template = true,
+    .have_self = true,
+    .self_type = PVecOfT,
+    .result_type = TYPE_Template,
+    .arg_types{},
+    .impl = builtin::pvec_pop,
+    .modify_self = true,
+    .result_type_of = element_of_self,
+  },
+
+  BUILTIN_FUNC_FULL("len", builtin::pvec_len, true, true, PVecOfT, TYPE_Int),
+
+  BuiltinFunc{
+    .name = "to_vector",
+    .is_template = true,
+    .have_self = true,
+    .self_type = PVecOfT,
+    .result_type = TypeInfo(TYPE_Vector, {TYPE_Template}),
+    .arg_types{},
+    .impl = builtin::pvec_to_vector,
+    .borrow_self = true,
+    .result_type_of =
+      [](TypeInfo const& self) {
+        return TypeInfo(TYPE_Vector, {self.type_params[0]});
+      },
+  },
+
+  BuiltinFunc{
+    .name = "to_pvector",
+    .is_template = true,
+    .have_self = true,
+    .self_type = TypeInfo(TYPE_Vector, {TYPE_Template}),
+    .result_type = PVecOfT,
+    .arg_types{},
+    .impl = builtin::to_pvector,
+    .borrow_self = true,
+    .result_type_of =
+      [](TypeInfo const& self) {
+        return TypeInfo(TYPE_PVector, {self.type_params[0]});
+      },
+  },
+
+  BuiltinFunc{
+    .name = "get",
+    .is_template = true,
+    .have_self = true,
+    .self_type = PDictOfT,
+    .result_type = TYPE_Template,
+    .arg_types{TYPE_Template, TYPE_Template},
+    .impl = builtin::pdict_get,
+    .borrow_self = true,
+    .result_type_of = [](TypeInfo const& self) { return self.type_params[1]; },
+  },
+
+  BUILTIN_FUNC_FULL("contains", builtin::pdict_contains, true, true, PDictOfT,
+                    TYPE_Bool, TYPE_Template),
+  BUILTIN_FUNC_MODIFY_SELF("remove", builtin::pdict_remove, true, PDictOfT,
+                           TYPE_Bool, TYPE_Template),
+  BUILTIN_FUNC_FULL("len", builtin::pdict_len, true, true, PDictOfT, TYPE_Int),
+
+  BUILTIN_FUNC_MODIFY_SELF("set", builtin::bitset_set, false, TYPE_Bitset,
+                           TYPE_None, TYPE_Int),
+  BUILTIN_FUNC_MODIFY_SELF("clear", builtin::bitset_clear, false,
+                           TYPE_Bitset, TYPE_None, TYPE_Int),
+  BUILTIN_FUNC_FULL("test", builtin::bitset_test, false, true, TYPE_Bitset,
+                    TYPE_Bool, TYPE_Int),
+  BUILTIN_FUNC_FULL("count", builtin::bitset_count, false, true, TYPE_Bitset,
+                    TYPE_Int),
+  BUILTIN_FUNC_FULL("len", builtin::bitset_len, false, true, TYPE_Bitset,
+                    TYPE_Int),
+  BUILTIN_FUNC_MODIFY_SELF("resize", builtin::bitset_resize, false,
+                           TYPE_Bitset, TYPE_None, TYPE_Int),
+  BUILTIN_FUNC_MODIFY_SELF("and", builtin::bitset_and, false, TYPE_Bitset,
+                           TYPE_None, TYPE_Bitset),
+  BUILTIN_FUNC_MODIFY_SELF("or", builtin::bitset_or, false, TYPE_Bitset,
+                           TYPE_None, TYPE_Bitset),
+  BUILTIN_FUNC_MODIFY_SELF("xor", builtin::bitset_xor, false, TYPE_Bitset,
+                           TYPE_None, TYPE_Bitset),
+  BUILTIN_FUNC_MODIFY_SELF("not", builtin::bitset_not, false, TYPE_Bitset,
+                           TYPE_None),
+
+  //
+  // ndarray<int>, ndarray<float>
+  BUILTIN_FUNC_FULL("reshape", builtin::vec_reshape<int64_t>, false, true,
+                    VecInt, NdInt, VecInt),
+  BUILTIN_FUNC_FULL("reshape", builtin::vec_reshape<float>, false, true,
+                    VecFloat, NdFloat, VecInt),
+
+  BuiltinFunc{
+    .name = "reshape",
+    .is_template = true,
+    .have_self = true,
+    .self_type = NdOfT,
+    .result_type = NdOfT,
+    .arg_types{VecInt},
+    .impl = builtin::nd_reshape,
+    .borrow_self = true,
+    .result_type_of = same_as_self,
+  },
+
+  BuiltinFunc{
+    .name = "transpose",
+    .is_template = true,
+    .have_self = true,
+    .self_type = NdOfT,
+    .result_type = NdOfT,
+    .arg_types{},
+    .impl = builtin::nd_transpose,
+    .borrow_self = true,
+    .result_type_of = same_as_self,
+  },
+
+  BUILTIN_FUNC_FULL("shape", builtin::nd_shape, true, true, NdOfT, VecInt),
+
+  BUILTIN_FUNC_FULL("to_vector", builtin::nd_to_vector<int64_t>, false, true,
+                    NdInt, VecInt),
+  BUILTIN_FUNC_FULL("to_vector", builtin::nd_to_vector<float>, false, true,
+                    NdFloat, VecFloat),
+
+  BUILTIN_FUNC_FULL("sum", builtin::nd_sum<int64_t>, false, true, NdInt,
+                    TYPE_Int),
+  BUILTIN_FUNC_FULL("sum", builtin::nd_sum<float>, false, true, NdFloat,
+                    TYPE_Float),
+  BUILTIN_FUNC_FULL("min", builtin::nd_min<int64_t>, false, true, NdInt,
+                    TYPE_Int),
+  BUILTIN_FUNC_FULL("min", builtin::nd_min<float>, false, true, NdFloat,
+                    TYPE_Float),
+  BUILTIN_FUNC_FULL("max", builtin::nd_max<int64_t>, false, true, NdInt,
+                    TYPE_Int),
+  BUILTIN_FUNC_FULL("max", builtin::nd_max<float>, false, true, NdFloat,
+                    TYPE_Float),
+
+  BUILTIN_FUNC_FULL("sum", builtin::nd_sum_axis<int64_t>, false, true, NdInt,
+                    NdInt, TYPE_Int),
+  BUILTIN_FUNC_FULL("sum", builtin::nd_sum_axis<float>, false, true, NdFloat,
+                    NdFloat, TYPE_Int),
+  BUILTIN_FUNC_FULL("min", builtin::nd_min_axis<int64_t>, false, true, NdInt,
+                    NdInt, TYPE_Int),
+  BUILTIN_FUNC_FULL("min", builtin::nd_min_axis<float>, false, true, NdFloat,
+                    NdFloat, TYPE_Int),
+  BUILTIN_FUNC_FULL("max", builtin::nd_max_axis<int64_t>, false, true, NdInt,
+                    NdInt, TYPE_Int),
+  BUILTIN_FUNC_FULL("max", builtin::nd_max_axis<float>, false, true, NdFloat,
+                    NdFloat, TYPE_Int),
+
+  BUILTIN_FUNC_FULL("matmul", builtin::nd_matmul<int64_t>, false, true, NdInt,
+                    NdInt, NdInt),
+  BUILTIN_FUNC_FULL("matmul", builtin::nd_matmul<float>, false, true,
+                    NdFloat, NdFloat, NdFloat),
+
+  BuiltinFunc{
+    .name = "heapify",
+    .is_template = true,
+    .have_self = true,
+    .self_type = TypeInfo(TYPE_Vector, {TYPE_Template}),
+    .result_type = HeapOfT,
+    .arg_types{},
+    .impl = builtin::heapify,
+    .borrow_self = true,
+    .result_type_of =
+      [](TypeInfo const& self) {
+        return TypeInfo(TYPE_Heap, {self.type_params[0]});
+      },
+  },
+
+  BUILTIN_FUNC_MODIFY_SELF("sort", builtin::sort, true,
+                           TypeInfo(TYPE_Vector, {TYPE_Template}), TYPE_None),
+  BUILTIN_FUNC_MODIFY_SELF("sort_desc", builtin::sort_desc, true,
+                           TypeInfo(TYPE_Vector, {TYPE_Template}), TYPE_None),
+  BUILTIN_FUNC_MODIFY_SELF("stable_sort", builtin::stable_sort, true,
+                           TypeInfo(TYPE_Vector, {TYPE_Template}), TYPE_None),
+  BUILTIN_FUNC_MODIFY_SELF("sort_by_key", builtin::sort_by_key, true,
+                           TypeInfo(TYPE_Vector, {TYPE_Template}), TYPE_None,
+                           TypeInfo(TYPE_Vector, {TYPE_Template})),
+  BUILTIN_FUNC_FULL("binary_search", builtin::binary_search, true, true,
+                    TypeInfo(TYPE_Vector, {TYPE_Template}), TYPE_Int,
                     TYPE_Template),
 
+  BUILTIN_FUNC_MODIFY_SELF("scale", builtin::vec_scale<int64_t>, false,
+                           VecInt, TYPE_None, TYPE_Int),
+  BUILTIN_FUNC_MODIFY_SELF("scale", builtin::vec_scale<float>, false,
+                           VecFloat, TYPE_None, TYPE_Float),
+
+  BUILTIN_FUNC_MODIFY_SELF("add", builtin::vec_add<int64_t>, false, VecInt,
+                           TYPE_None, VecInt),
+  BUILTIN_FUNC_MODIFY_SELF("add", builtin::vec_add<float>, false, VecFloat,
+                           TYPE_None, VecFloat),
+
+  BUILTIN_FUNC_MODIFY_SELF("fill", builtin::vec_fill<int64_t>, false, VecInt,
+                           TYPE_None, TYPE_Int),
+  BUILTIN_FUNC_MODIFY_SELF("fill", builtin::vec_fill<float>, false,
+                           VecFloat, TYPE_None, TYPE_Float),
+
+  BUILTIN_FUNC_FULL("count", builtin::vec_count<int64_t>, false, true,
+                    VecInt, TYPE_Int, TYPE_Int),
+  BUILTIN_FUNC_FULL("count", builtin::vec_count<float>, false, true,
+                    VecFloat, TYPE_Int, TYPE_Float),
+
+  BUILTIN_FUNC_FULL("index_of", builtin::vec_index_of<int64_t>, false, true,
+                    VecInt, TYPE_Int, TYPE_Int),
+  BUILTIN_FUNC_FULL("index_of", builtin::vec_index_of<float>, false, true,
+                    VecFloat, TYPE_Int, TYPE_Float),
+
   BUILTIN_FUNC_FULL("substr", builtin::substr, false, true, TYPE_String,
-                    TYPE_String, TYPE_USize),
+                    TYPE_String, TYPE_Int),
+  BUILTIN_FUNC_FULL("substr", builtin::substr, false, true, TYPE_String,
+                    TYPE_String, TYPE_Int, TYPE_Int),
 
   BUILTIN_FUNC_FULL("replace", builtin::replace, false, true, TYPE_String,
                     TYPE_String, TYPE_String, TYPE_String),
 
+  BUILTIN_FUNC("intern", builtin::intern, TYPE_String, TYPE_String),
+
+  BUILTIN_FUNC_FULL("find", builtin::find, false, true, TYPE_String,
+                    TYPE_Int, TYPE_String),
+
+  BUILTIN_FUNC_FULL("contains", builtin::contains, false, true, TYPE_String,
+                    TYPE_Bool, TYPE_String),
+
+  BUILTIN_FUNC_FULL("count", builtin::count, false, true, TYPE_String,
+                    TYPE_Int, TYPE_String),
+
+  BUILTIN_FUNC_FULL("split", builtin::split, false, true, TYPE_String,
+                    TypeInfo(TYPE_Vector, {TYPE_String}), TYPE_String),
+
+  BUILTIN_FUNC_MODIFY_SELF("push", builtin::builder_push, false,
+                           TYPE_StringBuilder, TYPE_None, TYPE_Char),
+  BUILTIN_FUNC_MODIFY_SELF("push_str", builtin::builder_push_str, false,
+                           TYPE_StringBuilder, TYPE_None, TYPE_String),
+  BUILTIN_FUNC_MODIFY_SELF("push_int", builtin::builder_push_int, false,
+                           TYPE_StringBuilder, TYPE_None, TYPE_Int),
+  BUILTIN_FUNC_MODIFY_SELF("reserve", builtin::builder_reserve, false,
+                           TYPE_StringBuilder, TYPE_None, TYPE_Int),
+  BUILTIN_FUNC_FULL("len", builtin::builder_len, false, true,
+                    TYPE_StringBuilder, TYPE_Int),
+  BUILTIN_FUNC_MODIFY_SELF("build", builtin::builder_build, false,
+                           TYPE_StringBuilder, TYPE_String),
+
   BUILTIN_FUNC("input", builtin::input, TYPE_String),
 
   BUILTIN_FUNC("open", builtin::open, TYPE_String, TYPE_String),
 
+  BUILTIN_FUNC_FULL("validate_utf8", builtin::validate_utf8, false, true,
+                    TYPE_String, TYPE_Bool),
+  BUILTIN_FUNC_FULL("byte_len", builtin::byte_len, false, true, TYPE_String,
+                    TYPE_Int),
+
   BUILTIN_FUNC("exit", builtin::exit, TYPE_Int),
+  BUILTIN_FUNC("exit", builtin::exit, TYPE_Int, TYPE_Int),
+
+  BUILTIN_FUNC("heap_stats", builtin::heap_stats,
+               TypeInfo(TYPE_Dict, {TYPE_String, TYPE_Int})),
+
+  BUILTIN_FUNC("dump_heap", builtin::dump_heap, TYPE_Bool, TYPE_String),
 };
 
 std::vector<BuiltinFunc> const& BuiltinFunc::get_builtin_list()
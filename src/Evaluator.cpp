@@ -12,6 +12,7 @@
 #include "Error.h"
 #include "Sema.h"
 #include "Evaluator.h"
+#include "Heap.h"
 
 #define astdef(T) auto ast = (AST::T*)_ast
 
@@ -25,10 +26,23 @@ Object::Object(TypeInfo type)
     no_delete(false)
 {
   Evaluator::allocated_objects[this] = 1;
+
+  Heap::charge(this->type.kind, this);
 }
 
 Object::~Object()
 {
+  Heap::uncharge(this->type.kind, this);
+}
+
+void* Object::operator new(size_t size)
+{
+  return Heap::allocate(size);
+}
+
+void Object::operator delete(void* p)
+{
+  Heap::deallocate(p);
 }
 
 std::string Evaluator::var_storage::to_string() const
@@ -106,6 +120,9 @@ Object* Evaluator::default_constructor(TypeInfo const& type,
     case TYPE_String:
       return new ObjString;
 
+    case TYPE_StringBuilder:
+      return new ObjStringBuilder;
+
     case TYPE_Dict: {
       auto ret = new ObjDict;
 
@@ -114,20 +131,41 @@ Object* Evaluator::default_constructor(TypeInfo const& type,
       return ret;
     }
 
-    case TYPE_Vector: {
-      auto ret = new ObjVector;
+    case TYPE_Vector:
+      return new ObjVector(type);
 
-      ret->type = type;
+    case TYPE_Set:
+      return new ObjSet(type);
 
-      return ret;
-    }
+    case TYPE_Deque:
+      return new ObjDeque(type);
+
+    case TYPE_Heap:
+      return new ObjHeap(type);
+
+    case TYPE_Bitset:
+      return new ObjBitset;
+
+    case TYPE_NdArray:
+      return ObjNdArray::create(type.type_params[0].kind, {0});
+
+    case TYPE_PVector:
+      return new ObjPVector(type);
+
+    case TYPE_PDict:
+      return new ObjPDict(type);
 
     case TYPE_UserDef: {
-      auto ret = new ObjUserType(type.userdef_type);
+      auto ret = ObjUserType::create(type.userdef_type);
 
+      //
+      // スカラー型のメンバは 0 で初期化済み
       if (construct_member && type.userdef_type->kind == AST_Struct) {
-        for (auto&& member : type.members) {
-          ret->add_member(this->default_constructor(member.second));
+        for (size_t i = 0; auto&& member : type.members) {
+          if (!ret->is_inline(i))
+            ret->set_member(i, this->default_constructor(member.second));
+
+          i++;
         }
       }
 
@@ -144,6 +182,41 @@ void Evaluator::eval_expr_elem(AST::Expr::Element const& elem, Object* dest)
 
   auto right = this->evaluate(elem.ast);
 
+  //
+  // n 次元配列
+  //  --> 要素ごとに計算する
+  if (dest->type.kind == TYPE_NdArray) {
+    auto arr = (ObjNdArray*)dest;
+
+    if (right->type.kind == TYPE_NdArray &&
+        ((ObjNdArray*)right)->shape != arr->shape) {
+      Error(op, "shape mismatch").emit().exit();
+    }
+
+    // 整数の割り算
+    if (elem.kind == AST::EX_Div && arr->elem_kind() == TYPE_Int) {
+      bool zero = false;
+
+      if (right->type.kind == TYPE_NdArray) {
+        auto r = (ObjNdArray*)right;
+        auto p = (int64_t const*)r->buffer->data();
+
+        for (size_t i = 0; !zero && i < r->size(); i++)
+          zero = p[r->position(i)] == 0;
+      }
+      else {
+        zero = ((ObjLong*)right)->value == 0;
+      }
+
+      if (zero) {
+        Error(op, "division by zero").emit().exit();
+      }
+    }
+
+    arr->combine(elem.kind, right);
+    return;
+  }
+
   switch (elem.kind) {
     case AST::EX_Add: {
       switch (dest->type.kind) {
@@ -323,13 +396,12 @@ Object* Evaluator::create_object(AST::Value* ast)
       break;
 
     case TYPE_String: {
-      auto ws = Utils::String::to_wstr(std::string(ast->token.str));
+      auto const& str = ast->token.str;
 
       // remove double quotation
-      ws.erase(ws.begin());
-      ws.pop_back();
-
-      obj = new ObjString(std::move(ws));
+      obj = (new ObjString(metro_string_t::from_utf8(
+               str.substr(1, str.length() - 2))))
+              ->intern();
 
       break;
     }
@@ -390,6 +462,8 @@ Object* Evaluator::evaluate(AST::Base* _ast)
   if (!_ast)
     return new ObjNone();
 
+  Heap::set_site(_ast);
+
   if (_ast->use_default)
     return this->default_constructor(Sema::value_type_cache[_ast]);
 
@@ -463,12 +537,12 @@ Object* Evaluator::evaluate(AST::Base* _ast)
     case AST_Vector: {
       astdef(Vector);
 
-      auto ret = new ObjVector();
+      auto ret = new ObjVector(Sema::value_type_cache[ast]);
 
-      ret->type = Sema::value_type_cache[ast];
+      ret->reserve(ast->elements.size());
 
       for (auto&& e : ast->elements) {
-        ret->append(this->evaluate(e));
+        ret->append(this->eval_for_store(e));
       }
 
       return ret;
@@ -495,13 +569,25 @@ Object* Evaluator::evaluate(AST::Base* _ast)
     case AST_IndexRef: {
       astdef(IndexRef);
 
-      auto obj = this->evaluate(ast->expr);
-
       if (ast->indexes.empty()) {
-        return obj;
+        return this->evaluate(ast->expr);
       }
 
-      return this->eval_index_ref(obj, ast);
+      //
+      // 変数であれば、全体をコピーせずに参照した要素だけをコピーする
+      if (ast->expr->kind == AST_Variable) {
+        auto& ref =
+          this->eval_index_ref(this->eval_left(ast->expr), ast, false);
+
+        if (&ref == &this->proxy.object)
+          return ref;
+
+        return ref->clone();
+      }
+
+      auto obj = this->evaluate(ast->expr);
+
+      return this->eval_index_ref(obj, ast, false);
     }
 
     //
@@ -513,7 +599,8 @@ Object* Evaluator::evaluate(AST::Base* _ast)
       ret->type = Sema::value_type_cache[_ast];
 
       for (auto&& elem : ast->elements) {
-        ret->append(this->evaluate(elem.key), this->evaluate(elem.value));
+        ret->append(this->eval_for_store(elem.key),
+                    this->eval_for_store(elem.value));
       }
 
       return ret;
@@ -539,10 +626,10 @@ Object* Evaluator::evaluate(AST::Base* _ast)
     case AST_StructConstructor: {
       astdef(StructConstructor);
 
-      auto ret = new ObjUserType(ast->p_struct);
+      auto ret = ObjUserType::create(ast->p_struct);
 
-      for (auto&& pair : ast->init_pair_list) {
-        ret->add_member(this->evaluate(pair.expr));
+      for (size_t i = 0; auto&& pair : ast->init_pair_list) {
+        ret->set_member(i++, this->eval_for_store(pair.expr));
       }
 
       return ret;
@@ -573,9 +660,29 @@ Object* Evaluator::evaluate(AST::Base* _ast)
 
       auto& dest = this->eval_left(ast->dest);
 
+      //
+      // 値を直接持つ要素への代入
+      //  --> 元の場所に書き戻す
+      if (&dest == &this->proxy.object) {
+        auto proxy = this->proxy;
+
+        // 右辺の評価中にキーが解放されないようにする
+        if (proxy.key)
+          proxy.key->ref_count++;
+
+        auto value = this->eval_for_store(ast->expr);
+
+        this->store_element(proxy, value);
+
+        if (proxy.key)
+          proxy.key->ref_count--;
+
+        return value;
+      }
+
       dest->ref_count--;
 
-      dest = this->evaluate(ast->expr);
+      dest = this->eval_for_store(ast->expr);
       dest->ref_count++;
 
       return dest;
@@ -607,7 +714,10 @@ Object* Evaluator::evaluate(AST::Base* _ast)
     case AST_Scope: {
       auto ast = (AST::Scope*)_ast;
 
-      if (ast->list.empty())
+      // 一番外側のスコープ
+      bool is_root = this->vst_list.empty();
+
+      if (ast->list.empty() && !is_root)
         break;
 
       auto& vst = this->push_vst();
@@ -635,6 +745,10 @@ Object* Evaluator::evaluate(AST::Base* _ast)
         }
       }
 
+      // 変数が生きているうちに書き出す
+      if (is_root)
+        Heap::dump_on_exit();
+
       for (auto&& x : vst.lvar_list) {
         x->ref_count--;
       }
@@ -654,13 +768,28 @@ Object* Evaluator::evaluate(AST::Base* _ast)
     case AST_Let: {
       auto ast = (AST::VariableDeclaration*)_ast;
 
+      //
+      // スカラー置換された構造体
+      //  --> メンバをそれぞれ変数として追加する
+      if (ast->is_scalar_replaced) {
+        auto ctor = (AST::StructConstructor*)ast->init;
+
+        for (auto&& pair : ctor->init_pair_list) {
+          this->get_vst()
+            .append_lvar(this->eval_for_store(pair.expr))
+            ->ref_count++;
+        }
+
+        break;
+      }
+
       Object* obj{};
 
       if (!ast->init || ast->ignore_initializer) {
         obj = this->default_constructor(Sema::value_type_cache[ast->type]);
       }
       else {
-        obj = this->evaluate(ast->init);
+        obj = this->eval_for_store(ast->init);
       }
 
       obj->ref_count++;
@@ -688,7 +817,7 @@ Object* Evaluator::evaluate(AST::Base* _ast)
 
         _gc_stopped = true;
 
-        fs.result = this->evaluate(ast->expr);
+        fs.result = this->eval_for_store(ast->expr);
 
         _gc_stopped = _flag_b;
 
@@ -817,6 +946,178 @@ Object* Evaluator::evaluate(AST::Base* _ast)
           break;
         }
 
+        //
+        // 集合
+        //  --> 追加した順に、要素の複製を変数に入れる
+        case TYPE_Set: {
+          auto obj = (ObjSet*)iterable;
+
+          auto var_index = v.lvar_list.size();
+
+          if (make_var)
+            v.append_lvar();
+
+          for (auto&& item : obj->items) {
+            if (item.is_removed())
+              continue;
+
+            // 本体で変数が追加されることがあるので、毎回取得する
+            auto& var = make_var ? v.get_lvar(var_index)
+                                 : this->eval_left(ast->iter);
+
+            if (var)
+              var->ref_count--;
+
+            var = item.key->clone();
+            var->ref_count++;
+
+            this->evaluate(ast->code);
+
+            if (loop.is_breaked) {
+              break;
+            }
+
+            loop.is_continued = false;
+          }
+
+          break;
+        }
+
+        //
+        // ビット列
+        //  --> 立っているビットの位置を、小さい順に変数に入れる
+        case TYPE_Bitset: {
+          auto obj = (ObjBitset*)iterable;
+
+          auto var_index = v.lvar_list.size();
+
+          if (make_var)
+            v.append_lvar();
+
+          // 本体で変更されることがあるので、毎回次の位置を探す
+          for (auto i = obj->find_next(0); i < obj->size();
+               i = obj->find_next(i + 1)) {
+            auto& var = make_var ? v.get_lvar(var_index)
+                                 : this->eval_left(ast->iter);
+
+            if (var)
+              var->ref_count--;
+
+            var = new ObjLong(i);
+            var->ref_count++;
+
+            this->evaluate(ast->code);
+
+            if (loop.is_breaked) {
+              break;
+            }
+
+            loop.is_continued = false;
+          }
+
+          break;
+        }
+
+        //
+        // 両端キュー
+        //  --> 先頭から順に、要素の複製を変数に入れる
+        case TYPE_Deque: {
+          auto obj = (ObjDeque*)iterable;
+
+          auto var_index = v.lvar_list.size();
+
+          if (make_var)
+            v.append_lvar();
+
+          for (size_t i = 0; i < obj->size(); i++) {
+            auto& var = make_var ? v.get_lvar(var_index)
+                                 : this->eval_left(ast->iter);
+
+            if (var)
+              var->ref_count--;
+
+            var = obj->at(i)->clone();
+            var->ref_count++;
+
+            this->evaluate(ast->code);
+
+            if (loop.is_breaked) {
+              break;
+            }
+
+            loop.is_continued = false;
+          }
+
+          break;
+        }
+
+        //
+        // 永続ベクタ
+        //  --> 先頭から順に、要素の複製を変数に入れる
+        case TYPE_PVector: {
+          auto obj = (ObjPVector*)iterable;
+
+          auto var_index = v.lvar_list.size();
+
+          if (make_var)
+            v.append_lvar();
+
+          for (size_t i = 0; i < obj->size(); i++) {
+            auto& var = make_var ? v.get_lvar(var_index)
+                                 : this->eval_left(ast->iter);
+
+            if (var)
+              var->ref_count--;
+
+            var = obj->get(i)->clone();
+            var->ref_count++;
+
+            this->evaluate(ast->code);
+
+            if (loop.is_breaked) {
+              break;
+            }
+
+            loop.is_continued = false;
+          }
+
+          break;
+        }
+
+        //
+        // 永続辞書
+        //  --> キーの複製を変数に入れる (ハッシュ値の順)
+        case TYPE_PDict: {
+          auto obj = (ObjPDict*)iterable;
+
+          auto var_index = v.lvar_list.size();
+
+          if (make_var)
+            v.append_lvar();
+
+          // iterable は本体での変更と節を共有しないので、先に集めてよい
+          for (auto&& [key, value] : obj->entries()) {
+            auto& var = make_var ? v.get_lvar(var_index)
+                                 : this->eval_left(ast->iter);
+
+            if (var)
+              var->ref_count--;
+
+            var = key->clone();
+            var->ref_count++;
+
+            this->evaluate(ast->code);
+
+            if (loop.is_breaked) {
+              break;
+            }
+
+            loop.is_continued = false;
+          }
+
+          break;
+        }
+
         default:
           todo_impl;
       }
@@ -885,9 +1186,16 @@ Object* Evaluator::evaluate(AST::Base* _ast)
   return new ObjNone;
 }
 
+Object* Evaluator::eval_for_store(AST::Base* ast)
+{
+  auto obj = this->evaluate(ast);
+
+  return ast->kind == AST_Value ? obj->clone() : obj;
+}
+
 Object* Evaluator::eval_callfunc(AST::CallFunc* ast)
 {
-  std::vector<Object*> args;
+  ObjectList args;
 
   for (auto&& arg : ast->args) {
     Object* obj{};
@@ -895,9 +1203,13 @@ Object* Evaluator::eval_callfunc(AST::CallFunc* ast)
     if (arg == *ast->args.begin() && ast->is_membercall && ast->is_lvalue) {
       obj = this->eval_left(arg);
     }
-    else {
+    else if (ast->is_builtin) {
+      // 格納する組み込み関数は、自分で複製する
       obj = this->evaluate(arg);
     }
+    else {
+      obj = this->eval_for_store(arg);
+    }
 
     args.emplace_back(obj)->ref_count++;
   }
@@ -906,6 +1218,20 @@ Object* Evaluator::eval_callfunc(AST::CallFunc* ast)
   if (ast->is_builtin) {
     BuiltinFunc::ArgumentVector bargs;
 
+    // 代入先の型で作成したオブジェクトを先頭に入れる
+    if (ast->builtin_func->use_expected_type) {
+      auto const& type = Sema::value_type_cache[ast];
+
+      if (type.kind == TYPE_Template) {
+        Error(ast, "cannot deduce the type of '" + ast->builtin_func->name +
+                     "', specify the type of the destination")
+          .emit()
+          .exit();
+      }
+
+      bargs.emplace_back(this->default_constructor(type), ast);
+    }
+
     for (auto argiter = ast->args.begin(); auto&& obj : args) {
       obj->ref_count--;
       bargs.emplace_back(obj, *argiter++);
@@ -957,6 +1283,59 @@ Object*& Evaluator::get_var(AST::Variable* ast)
   return std::next(this->vst_list.begin(), ast->step)->get_lvar(ast->index);
 }
 
+Object*& Evaluator::set_proxy(Object* owner, size_t index, Object* value,
+                              size_t field)
+{
+  this->proxy.owner = owner;
+  this->proxy.index = index;
+  this->proxy.field = field;
+  this->proxy.key = nullptr;
+
+  return this->proxy.object = value;
+}
+
+void Evaluator::store_element(ElementProxy const& proxy, Object* value)
+{
+  if (!proxy.owner)
+    return;
+
+  switch (proxy.owner->type.kind) {
+    case TYPE_String:
+      ((ObjString*)proxy.owner)->set_char(proxy.index, (ObjChar*)value);
+      break;
+
+    case TYPE_UserDef:
+      ((ObjUserType*)proxy.owner)->set_member(proxy.index, value);
+      break;
+
+    case TYPE_Vector: {
+      auto vec = (ObjVector*)proxy.owner;
+
+      if (proxy.field == ElementProxy::NoField)
+        vec->set_element(proxy.index, value);
+      else
+        vec->set_field(proxy.index, proxy.field, value);
+
+      break;
+    }
+
+    case TYPE_NdArray:
+      ((ObjNdArray*)proxy.owner)->set_element(proxy.index, value);
+      break;
+
+    case TYPE_PVector:
+      ((ObjPVector*)proxy.owner)->set(proxy.index, value);
+      break;
+
+    case TYPE_PDict:
+      ((ObjPDict*)proxy.owner)->set(proxy.key, value);
+      break;
+
+    default:
+      todo_impl;
+  }
+}
+
 Object*& Evaluator::eval_left(AST::Base* _ast)
 {
   switch (_ast->kind) {
@@ -973,16 +1352,53 @@ Object*& Evaluator::eval_left(AST::Base* _ast)
   throw 1;
 }
 
-Object*& Evaluator::eval_index_ref(Object*& obj, AST::IndexRef* ast)
+Object*& Evaluator::eval_index_ref(Object*& obj, AST::IndexRef* ast,
+                                   bool is_lvalue)
 {
   Object** ret = &obj;
-  Object* tmp = nullptr;
 
-  for (auto&& index : ast->indexes) {
+  for (size_t i = 0; i < ast->indexes.size(); i++) {
+    auto& index = ast->indexes[i];
+
     switch (index.kind) {
       case AST::IndexRef::Subscript::SUB_Index: {
+        // 添字の評価で proxy が上書きされる場合があるので、退避しておく
+        Object* holder = nullptr;
+
+        if (ret == &this->proxy.object) {
+          holder = *ret;
+          ret = &holder;
+        }
+
         auto obj_index = this->evaluate(index.ast);
 
+        //
+        // 範囲
+        //  --> 部分文字列・部分ベクタ
+        if (obj_index->type.kind == TYPE_Range) {
+          auto range = (ObjRange*)obj_index;
+
+          auto size = (*ret)->type.kind == TYPE_String
+                        ? ((ObjString*)*ret)->length()
+                        : ((ObjVector*)*ret)->size();
+
+          if (range->begin < 0 || range->begin > range->end ||
+              (size_t)range->end > size) {
+            Error(index.ast, "index out of range").emit().exit();
+          }
+
+          Object* slice;
+
+          if ((*ret)->type.kind == TYPE_String)
+            slice = ((ObjString*)*ret)->slice(range->begin, range->end);
+          else
+            slice = ((ObjVector*)*ret)->slice(range->begin, range->end);
+
+          ret = &this->set_proxy(nullptr, 0, slice);
+
+          continue;
+        }
+
         switch ((*ret)->type.kind) {
           case TYPE_String: {
             auto& obj_str = *(ObjString**)ret;
@@ -1002,11 +1418,13 @@ Object*& Evaluator::eval_index_ref(Object*& obj, AST::IndexRef* ast)
                 panic("int or usize??aa");
             }
 
-            if (indexval >= obj_str->characters.size()) {
+            if (indexval >= obj_str->length()) {
               Error(index.ast, "index out of range").emit().exit();
             }
 
-            ret = &(Object*&)obj_str->characters[indexval];
+            ret = &this->set_proxy(obj_str, indexval,
+                                   obj_str->get_char(indexval));
+
             break;
           }
 
@@ -1028,22 +1446,170 @@ Object*& Evaluator::eval_index_ref(Object*& obj, AST::IndexRef* ast)
                 panic("int or usize??aa");
             }
 
-            if (indexval >= obj_vec->elements.size()) {
+            if (indexval >= obj_vec->size()) {
               Error(index.ast, "index out of range").emit().exit();
             }
 
-            ret = &obj_vec->elements[indexval];
+            if (!obj_vec->is_columnar()) {
+              ret = &obj_vec->elements[indexval];
+              break;
+            }
+
+            //
+            // 列指向
+            //  --> 続けてメンバを参照するなら、その列から直接読む
+            if (i + 1 < ast->indexes.size() &&
+                ast->indexes[i + 1].kind ==
+                  AST::IndexRef::Subscript::SUB_Member) {
+              auto field = ((AST::Variable*)ast->indexes[++i].ast)->index;
+
+              ret = &this->set_proxy(obj_vec, indexval,
+                                     obj_vec->get_field(indexval, field),
+                                     field);
+            }
+            else {
+              ret = &this->set_proxy(obj_vec, indexval,
+                                     obj_vec->get_element(indexval));
+            }
+
+            break;
+          }
+
+          //
+          // n 次元配列
+          //  --> 添字はベクタ (各軸の位置)
+          case TYPE_NdArray: {
+            auto arr = *(ObjNdArray**)ret;
+            auto idx = (ObjVector*)obj_index;
+
+            if (idx->size() != arr->ndim()) {
+              Error(index.ast, "expected " + std::to_string(arr->ndim()) +
+                                 " indexes but found " +
+                                 std::to_string(idx->size()))
+                .emit()
+                .exit();
+            }
+
+            size_t linear = 0;
+
+            for (size_t k = 0; k < idx->size(); k++) {
+              auto x = idx->scalar_data<int64_t>()[k];
+
+              if (x < 0 || (size_t)x >= arr->shape[k]) {
+                Error(index.ast, "index out of range").emit().exit();
+              }
+
+              linear = linear * arr->shape[k] + x;
+            }
+
+            ret = &this->set_proxy(arr, linear, arr->get_element(linear));
+            break;
+          }
+
+          case TYPE_Deque: {
+            auto obj_deque = *(ObjDeque**)ret;
+
+            size_t indexval = 0;
+
+            switch (obj_index->type.kind) {
+              case TYPE_Int:
+                indexval = ((ObjLong*)obj_index)->value;
+                break;
+
+              case TYPE_USize:
+                indexval = ((ObjUSize*)obj_index)->value;
+                break;
+
+              default:
+                panic("int or usize??aa");
+            }
+
+            if (indexval >= obj_deque->size()) {
+              Error(index.ast, "index out of range").emit().exit();
+            }
+
+            ret = &obj_deque->at(indexval);
+            break;
+          }
+
+          //
+          // 永続ベクタ
+          //  --> 節と要素は他のバージョンと共有しているので、複製を読み出す
+          //      左辺値であれば、その複製を先に経路をコピーして書き込んでおく
+          //      (このバージョンだけの要素になるので、続く添字・メンバへの
+          //       代入や self を変更する関数は、そのまま変更してよい)
+          //      この要素への代入は store_element で書き込む
+          case TYPE_PVector: {
+            auto obj_vec = *(ObjPVector**)ret;
+
+            size_t indexval = 0;
+
+            switch (obj_index->type.kind) {
+              case TYPE_Int:
+                indexval = ((ObjLong*)obj_index)->value;
+                break;
+
+              case TYPE_USize:
+                indexval = ((ObjUSize*)obj_index)->value;
+                break;
+
+              default:
+                panic("int or usize??aa");
+            }
+
+            if (indexval >= obj_vec->size()) {
+              Error(index.ast, "index out of range").emit().exit();
+            }
+
+            auto elem = obj_vec->get(indexval)->clone();
+
+            if (is_lvalue)
+              obj_vec->set(indexval, elem);
+
+            ret = &this->set_proxy(obj_vec, indexval, elem);
+
+            break;
+          }
+
+          //
+          // 永続辞書
+          //  --> 永続ベクタと同じ
+          //      見つからなければデフォルト値を読み出す
+          //      (辞書と同じく、左辺値のときのみ追加する)
+          case TYPE_PDict: {
+            auto obj_dict = *(ObjPDict**)ret;
+            auto value = obj_dict->find(obj_index);
+
+            auto elem =
+              value ? value->clone()
+                    : this->default_constructor(obj_dict->type.type_params[1]);
+
+            if (is_lvalue)
+              obj_dict->set(obj_index, elem);
+
+            ret = &this->set_proxy(obj_dict, 0, elem);
+
+            this->proxy.key = obj_index;
             break;
           }
 
           case TYPE_Dict: {
             auto& obj_dict = *(ObjDict**)ret;
 
-            for (auto&& item : obj_dict->items) {
-              if (item.key->equals(obj_index)) {
-                ret = &item.value;
-                goto _dict_value_found;
-              }
+            if (auto item = obj_dict->find(obj_index); item) {
+              ret = &item->value;
+              break;
+            }
+
+            //
+            // 見つからない
+            //  --> 読み出しのときは get と同じく、追加せずにデフォルト値を返す
+            if (!is_lvalue) {
+              ret = &this->set_proxy(
+                nullptr, 0,
+                this->default_constructor(obj_dict->type.type_params[1]));
+
+              break;
             }
 
             ret = &obj_dict
@@ -1051,7 +1617,6 @@ Object*& Evaluator::eval_index_ref(Object*& obj, AST::IndexRef* ast)
                                            obj_dict->type.type_params[1]))
                      .value;
 
-          _dict_value_found:
             break;
           }
 
@@ -1063,15 +1628,24 @@ Object*& Evaluator::eval_index_ref(Object*& obj, AST::IndexRef* ast)
       }
 
       case AST::IndexRef::Subscript::SUB_Member: {
-        ret =
-          &((ObjUserType*)*ret)->members[((AST::Variable*)index.ast)->index];
+        auto obj_struct = (ObjUserType*)*ret;
+        auto member_index = ((AST::Variable*)index.ast)->index;
+
+        if (obj_struct->is_inline(member_index)) {
+          ret = &this->set_proxy(obj_struct, member_index,
+                                 obj_struct->get_member(member_index));
+        }
+        else {
+          ret = &obj_struct->ref_member(member_index);
+        }
 
         break;
       }
 
       case AST::IndexRef::Subscript::SUB_CallFunc: {
-        tmp = this->eval_callfunc((AST::CallFunc*)index.ast);
-        ret = &tmp;
+        ret = &this->set_proxy(
+          nullptr, 0, this->eval_callfunc((AST::CallFunc*)index.ast));
+
         break;
       }
 
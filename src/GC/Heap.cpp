@@ -0,0 +1,463 @@
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <new>
+
+#include "Utils.h"
+#include "Debug.h"
+
+#include "AST/AST.h"
+#include "Object/Object.h"
+
+#include "ScriptFileContext.h"
+#include "Heap.h"
+#include "Error.h"
+
+static Heap::Usage _usage[TYPE_Template + 1];
+
+static size_t _current;
+static size_t _peak;
+static size_t _count;
+
+static size_t _limit;
+
+//
+// 確保した領域の前に置くヘッダ
+//
+// new T(...) では確保の後に引数が評価されるので、サイズは
+// 静的変数ではなく領域ごとに持つ
+// 確保した領域はすべて双方向リストでつながれている
+struct alignas(std::max_align_t) AllocHeader {
+  AllocHeader* prev;
+  AllocHeader* next;
+
+  uint32_t size;
+  bool is_constructed;  // Object のコンストラクタが実行済み
+
+  AST::Base const* site;
+};
+
+static AllocHeader _live{&_live, &_live, 0, false, nullptr};
+
+static std::string _dump_path;
+
+static AllocHeader* get_header(void const* p)
+{
+  return (AllocHeader*)p - 1;
+}
+
+void* Heap::allocate(size_t size)
+{
+  auto header = (AllocHeader*)::operator new(sizeof(AllocHeader) + size);
+
+  header->size = (uint32_t)size;
+  header->is_constructed = false;
+  header->site = nullptr;
+
+  header->prev = _live.prev;
+  header->next = &_live;
+  _live.prev->next = header;
+  _live.prev = header;
+
+  return header + 1;
+}
+
+void Heap::deallocate(void* p)
+{
+  auto header = get_header(p);
+
+  header->prev->next = header->next;
+  header->next->prev = header->prev;
+
+  ::operator delete(header);
+}
+
+void Heap::charge(TypeKind kind, void const* p)
+{
+  auto header = get_header(p);
+  auto size = header->size;
+  auto& usage = _usage[kind];
+
+  header->is_constructed = true;
+  header->site = _site;
+
+  usage.bytes += size;
+  usage.count++;
+
+  _current += size;
+  _count++;
+
+  if (_current > _peak)
+    _peak = _current;
+
+  if (_limit != 0 && _current > _limit)
+    Heap::limit_exceeded();
+}
+
+void Heap::uncharge(TypeKind kind, void const* p)
+{
+  auto header = get_header(p);
+  auto size = header->size;
+  auto& usage = _usage[kind];
+
+  header->is_constructed = false;
+
+  usage.bytes -= size;
+  usage.count--;
+
+  _current -= size;
+  _count--;
+}
+
+void Heap::charge_buffer(TypeKind kind, size_t size)
+{
+  _usage[kind].bytes += size;
+  _current += size;
+
+  if (_current > _peak)
+    _peak = _current;
+
+  if (_limit != 0 && _current > _limit)
+    Heap::limit_exceeded();
+}
+
+void Heap::uncharge_buffer(TypeKind kind, size_t size)
+{
+  _usage[kind].bytes -= size;
+  _current -= size;
+}
+
+Heap::Usage const& Heap::get_usage(TypeKind kind)
+{
+  return _usage[kind];
+}
+
+size_t Heap::get_current()
+{
+  return _current;
+}
+
+size_t Heap::get_peak()
+{
+  return _peak;
+}
+
+size_t Heap::get_count()
+{
+  return _count;
+}
+
+void Heap::set_limit(size_t limit)
+{
+  _limit = limit;
+}
+
+size_t Heap::get_limit()
+{
+  return _limit;
+}
+
+void Heap::set_dump_path(std::string const& path)
+{
+  _dump_path = path;
+}
+
+std::string const& Heap::get_dump_path()
+{
+  return _dump_path;
+}
+
+void Heap::dump_on_exit()
+{
+  static bool dumped = false;
+
+  if (dumped || _dump_path.empty())
+    return;
+
+  dumped = true;
+
+  if (!Heap::dump(_dump_path))
+    Error::fatal_error("cannot write heap dump to '", _dump_path, "'");
+}
+
+void Heap::limit_exceeded()
+{
+  auto current = _current;
+  auto limit = _limit;
+
+  // 書き出している間の確保で、もう一度ここに来ないようにする
+  _limit = 0;
+
+  Heap::dump_on_exit();
+
+  Error::fatal_error("heap limit exceeded (", current, " > ", limit,
+                     " bytes)");
+}
+
+//
+// オブジェクトが持っている領域 (要素の配列など) も含めたサイズ
+static size_t get_shallow_size(Object* obj, size_t alloc_size)
+{
+  switch (obj->type.kind) {
+    case TYPE_String: {
+      // rope は共有されているので数えない
+      if (((ObjString*)obj)->rope)
+        return alloc_size;
+
+      auto const& str = ((ObjString*)obj)->value;
+      auto data = (unsigned char const*)str.data();
+
+      // 短い文字列はオブジェクトの中にある
+      if (data >= (unsigned char const*)obj &&
+          data < (unsigned char const*)obj + alloc_size)
+        return alloc_size;
+
+      return alloc_size + (str.capacity() + 1) * sizeof(metro_char_t);
+    }
+
+    case TYPE_StringBuilder:
+      return alloc_size + (((ObjStringBuilder*)obj)->buffer.capacity() + 1) *
+                            sizeof(metro_char_t);
+
+    case TYPE_Vector: {
+      auto vec = (ObjVector*)obj;
+      auto size = alloc_size;
+
+      // 自身の中に持っている分は alloc_size に含まれる
+      if (!vec->elements.is_inline())
+        size += vec->elements.capacity() * sizeof(Object*);
+
+      // 共有している列は、共有している数で割る
+      if (vec->columns) {
+        for (auto&& col : *vec->columns)
+          if (!col.is_inline())
+            size += col.capacity() / vec->columns.use_count();
+      }
+
+      return size;
+    }
+
+    case TYPE_Dict:
+      return alloc_size +
+             ((ObjDict*)obj)->items.capacity() * sizeof(ObjDict::Item);
+
+    case TYPE_Set:
+      return alloc_size +
+             ((ObjSet*)obj)->items.capacity() * sizeof(ObjSet::Item);
+
+    case TYPE_Deque:
+      return alloc_size + ((ObjDeque*)obj)->capacity() * sizeof(Object*);
+
+    case TYPE_Heap:
+      return alloc_size + ((ObjHeap*)obj)->capacity_bytes();
+
+    case TYPE_Bitset:
+      return alloc_size +
+             ((ObjBitset*)obj)->words.capacity() * sizeof(uint64_t);
+
+    // 共有している領域は、共有している数で割る
+    case TYPE_NdArray: {
+      auto arr = (ObjNdArray*)obj;
+
+      return alloc_size + arr->buffer->capacity() / arr->buffer.use_count();
+    }
+
+    //
+    // 永続ベクタ・辞書の節は、根を共有しているバージョンの数で割る
+    // (途中の節だけを共有していることもあるので、おおよその値)
+    case TYPE_PVector: {
+      auto vec = (ObjPVector*)obj;
+      auto nodes = vec->size() / PVecNode::Width + 1;
+
+      return alloc_size + nodes * sizeof(PVecNode) / vec->root.use_count();
+    }
+
+    case TYPE_PDict: {
+      auto dict = (ObjPDict*)obj;
+
+      if (!dict->root)
+        return alloc_size;
+
+      return alloc_size + dict->size() * sizeof(HamtNode::Entry) /
+                            dict->root.use_count();
+    }
+  }
+
+  return alloc_size;
+}
+
+//
+// obj が参照しているオブジェクト
+static void get_references(Object* obj, std::vector<Object*>& refs)
+{
+  switch (obj->type.kind) {
+    case TYPE_Vector:
+      for (auto&& e : ((ObjVector*)obj)->elements)
+        refs.emplace_back(e);
+
+      break;
+
+    case TYPE_Dict:
+      for (auto&& item : ((ObjDict*)obj)->items) {
+        if (item.is_removed())
+          continue;
+
+        refs.emplace_back(item.key);
+        refs.emplace_back(item.value);
+      }
+
+      break;
+
+    case TYPE_Set:
+      for (auto&& item : ((ObjSet*)obj)->items) {
+        if (!item.is_removed())
+          refs.emplace_back(item.key);
+      }
+
+      break;
+
+    case TYPE_Deque: {
+      auto deq = (ObjDeque*)obj;
+
+      for (size_t i = 0; i < deq->size(); i++)
+        refs.emplace_back(deq->at(i));
+
+      break;
+    }
+
+    case TYPE_Heap:
+      for (auto&& e : ((ObjHeap*)obj)->elements)
+        refs.emplace_back(e);
+
+      break;
+
+    case TYPE_PVector: {
+      auto vec = (ObjPVector*)obj;
+
+      for (size_t i = 0; i < vec->size(); i++)
+        refs.emplace_back(vec->get(i));
+
+      break;
+    }
+
+    case TYPE_PDict:
+      for (auto&& [key, value] : ((ObjPDict*)obj)->entries()) {
+        refs.emplace_back(key);
+        refs.emplace_back(value);
+      }
+
+      break;
+
+    case TYPE_Enumerator:
+      if (auto value = ((ObjEnumerator*)obj)->value; value)
+        refs.emplace_back(value);
+
+      break;
+
+    case TYPE_UserDef: {
+      auto ut = (ObjUserType*)obj;
+
+      for (size_t i = 0; i < ut->member_count(); i++) {
+        if (!ut->is_inline(i) && ut->ref_member(i))
+          refs.emplace_back(ut->ref_member(i));
+      }
+
+      break;
+    }
+  }
+}
+
+template <class T>
+static void write(std::ofstream& ofs, T value)
+{
+  ofs.write((char const*)&value, sizeof(T));
+}
+
+static void write_string(std::ofstream& ofs, std::string const& str)
+{
+  write<uint32_t>(ofs, (uint32_t)str.length());
+  ofs.write(str.data(), str.length());
+}
+
+//
+// 書き出すオブジェクト
+// 参照カウントが 0 のもの (clean_obj でまだ解放されていない一時的な値) は除く
+static bool is_dumped(AllocHeader const* h)
+{
+  return h->is_constructed && ((Object const*)(h + 1))->ref_count != 0;
+}
+
+bool Heap::dump(std::string const& path)
+{
+  std::ofstream ofs{path, std::ios::binary};
+
+  if (!ofs)
+    return false;
+
+  std::map<AST::Base const*, uint32_t> site_ids;
+  std::vector<std::string> sites;
+  uint64_t count = 0;
+
+  for (auto h = _live.next; h != &_live; h = h->next) {
+    if (!is_dumped(h))
+      continue;
+
+    count++;
+
+    if (h->site && !site_ids.contains(h->site)) {
+      auto const& loc = h->site->token.src_loc;
+
+      site_ids[h->site] = (uint32_t)sites.size();
+
+      sites.emplace_back(
+        (loc.context ? loc.context->get_path() : std::string("<unknown>")) +
+        ":" + std::to_string(loc.line_num));
+    }
+  }
+
+  ofs.write("METROHP2", 8);
+
+  // 型の名前 (TypeKind の値は追加すると変わるので、名前で読むため)
+  auto kinds = TypeInfo::get_kind_and_names();
+
+  kinds.emplace_back(TYPE_UserDef, "struct");
+
+  write<uint32_t>(ofs, (uint32_t)kinds.size());
+
+  for (auto&& [kind, name] : kinds) {
+    write<uint8_t>(ofs, (uint8_t)kind);
+    write_string(ofs, name);
+  }
+
+  write<uint32_t>(ofs, (uint32_t)sites.size());
+
+  for (auto&& site : sites)
+    write_string(ofs, site);
+
+  write<uint64_t>(ofs, count);
+
+  std::vector<Object*> refs;
+
+  for (auto h = _live.next; h != &_live; h = h->next) {
+    if (!is_dumped(h))
+      continue;
+
+    auto obj = (Object*)(h + 1);
+
+    refs.clear();
+    get_references(obj, refs);
+
+    write<uint64_t>(ofs, (uint64_t)obj);
+    write<uint8_t>(ofs, (uint8_t)obj->type.kind);
+    write<uint64_t>(ofs, get_shallow_size(obj, h->size));
+    write<uint64_t>(ofs, obj->ref_count);
+    write<uint32_t>(ofs, h->site ? site_ids[h->site] : 0xFFFFFFFF);
+    write<uint32_t>(ofs, (uint32_t)refs.size());
+
+    for (auto&& r : refs)
+      write<uint64_t>(ofs, (uint64_t)r);
+  }
+
+  return ofs.good();
+}
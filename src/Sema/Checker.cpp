@@ -64,6 +64,26 @@ TypeInfo Sema::check_indexref(AST::IndexRef* ast)
     usertype = this->find_usertype(((AST::Variable*)ast->expr)->name);
 
   if (!usertype) {
+    //
+    // スカラー置換された構造体のメンバ
+    //  --> メンバの変数を直接参照する
+    if (ast->expr->kind == AST_Variable && !ast->indexes.empty() &&
+        ast->indexes[0].kind == SubscriptKind::SUB_Member) {
+      auto var = (AST::Variable*)ast->expr;
+
+      if (auto [p, s, i] = this->find_scalar_member(
+            var->name, ast->indexes[0].ast->token.str);
+          p) {
+        var->step = s;
+        var->index = i;
+
+        this->value_type_cache[var] = p->type;
+
+        delete ast->indexes[0].ast;
+        ast->indexes.erase(ast->indexes.begin());
+      }
+    }
+
     type = this->check(ast->expr);
     goto check_indexes;
   }
@@ -169,6 +189,9 @@ TypeInfo Sema::check_indexref(AST::IndexRef* ast)
   }
 
 check_indexes:
+  // メンバ関数を呼び出す前の型 (self の型)
+  std::vector<TypeInfo> self_types(ast->indexes.size());
+
   for_indexed(i, index, ast->indexes)
   {
     switch (index.kind) {
@@ -182,6 +205,11 @@ check_indexes:
           // vector or string
           case TYPE_String:
           case TYPE_Vector:
+            // 範囲
+            //  --> 部分文字列・部分ベクタ (型は同じ)
+            if (index_type.kind == TYPE_Range)
+              break;
+
             if (index_type.kind != TYPE_Int && index_type.kind != TYPE_USize) {
               Error(index.ast, "expected integer or usize").emit();
             }
@@ -193,9 +221,32 @@ check_indexes:
 
             break;
 
+          //
+          // n 次元配列
+          //  --> 各軸の位置を vector<int> で指定する
+          case TYPE_NdArray:
+            if (!index_type.equals(TypeInfo(TYPE_Vector, {TYPE_Int}))) {
+              Error(index.ast, "expected vector<int>").emit().exit();
+            }
+
+            type = type.type_params[0];
+            break;
+
+          //
+          // deque, 永続ベクタ
+          case TYPE_Deque:
+          case TYPE_PVector:
+            if (index_type.kind != TYPE_Int && index_type.kind != TYPE_USize) {
+              Error(index.ast, "expected integer or usize").emit().exit();
+            }
+
+            type = type.type_params[0];
+            break;
+
           //
           // Disctionary
-          case TYPE_Dict: {
+          case TYPE_Dict:
+          case TYPE_PDict: {
             // キーの型と一致しない場合エラー
             if (!index_type.equals(type.type_params[0])) {
               Error(index.ast, "expecte '" + type.type_params[0].to_string() +
@@ -278,6 +329,7 @@ check_indexes:
         // if ast->expr is a type name, it's static member-function call.
         cf->is_membercall = i > 0 || !is_first_typename;
 
+        self_types[i] = type;
         type = this->check_function_call(cf, cf->is_membercall, type);
 
         this->value_type_cache[cf] = type;
@@ -295,18 +347,50 @@ check_indexes:
 
     ast->expr = ast->indexes[0].ast;
     ast->indexes.erase(ast->indexes.begin());
+    self_types.erase(self_types.begin());
 
     delete x;
   }
 
-  while (!ast->indexes.empty() &&
-         ast->indexes[0].kind == SubscriptKind::SUB_CallFunc) {
-    auto cf = (AST::CallFunc*)ast->indexes[0].ast;
+  //
+  // メンバ関数の呼び出し
+  //  --> それより前の部分を self として、引数の先頭に入れる
+  //      (a[i].f() であれば、a[i] を新しい IndexRef にする)
+  while (true) {
+    auto it = std::find_if(
+      ast->indexes.begin(), ast->indexes.end(), [](auto const& index) {
+        return index.kind == SubscriptKind::SUB_CallFunc;
+      });
+
+    if (it == ast->indexes.end())
+      break;
+
+    auto k = it - ast->indexes.begin();
+    auto cf = (AST::CallFunc*)it->ast;
+    auto self = ast->expr;
+
+    if (k > 0) {
+      auto prefix = new AST::IndexRef(ast->token, ast->expr);
+
+      prefix->indexes.assign(ast->indexes.begin(), it);
+      this->value_type_cache[prefix] = self_types[k];
+
+      self = prefix;
+    }
 
-    cf->args.insert(cf->args.begin(), ast->expr);
+    // self を変更する組み込み関数には、変数そのものを渡す
+    // 変更しないもの (borrow_self) も、変数であれば複製せずに渡す
+    if (cf->is_builtin &&
+        ((cf->builtin_func->modify_self &&
+          (self->kind == AST_Variable || self->kind == AST_IndexRef)) ||
+         (cf->builtin_func->borrow_self && self->kind == AST_Variable)))
+      cf->is_lvalue = true;
+
+    cf->args.insert(cf->args.begin(), self);
 
     ast->expr = cf;
-    ast->indexes.erase(ast->indexes.begin());
+    ast->indexes.erase(ast->indexes.begin(), it + 1);
+    self_types.erase(self_types.begin(), self_types.begin() + k + 1);
   }
 
   return type;
@@ -553,9 +637,6 @@ TypeInfo Sema::check(AST::Base* _ast)
 
       _ret = TYPE_Dict;
 
-      TypeInfo key_type;
-      TypeInfo value_type;
-
       auto item_iter = ast->elements.begin();
 
       if (ast->key_type) {
@@ -570,8 +651,8 @@ TypeInfo Sema::check(AST::Base* _ast)
       }
 
       for (; item_iter != ast->elements.end(); item_iter++) {
-        this->expect(key_type, item_iter->key);
-        this->expect(value_type, item_iter->value);
+        this->expect(_ret.type_params[0], item_iter->key);
+        this->expect(_ret.type_params[1], item_iter->value);
       }
 
       break;
@@ -696,11 +777,35 @@ TypeInfo Sema::check(AST::Base* _ast)
         }
 
         type = this->check(ast->init);
+
+        // 型が代入先で決まる式 (with_capacity など)
+        if (type.kind == TYPE_Template) {
+          Error(ast, "cannot deduction variable type").emit().exit();
+        }
       }
 
       // 同スコープ内で同じ名前の変数を探す
       auto pvar = scope_emu.lvar.find_var(ast->name);
 
+      //
+      // スカラー置換
+      //  --> メンバごとに変数を追加する
+      if (ast->is_scalar_replaced) {
+        if (pvar || ast->ignore_initializer || type.kind != TYPE_UserDef) {
+          ast->is_scalar_replaced = false;
+        }
+        else {
+          for (auto&& [name, member_type] : type.members) {
+            auto& var = scope_emu.lvar.append(member_type, ast->name);
+
+            var.is_scalar_member = true;
+            var.member = name;
+          }
+
+          break;
+        }
+      }
+
       // すでに定義済みの同じ名前があって、違う型
       //  => シャドウイングする
       if (pvar && !pvar->type.equals(type)) {
@@ -840,11 +945,16 @@ TypeInfo Sema::check(AST::Base* _ast)
 
       switch (iterable.kind) {
         case TYPE_Range:
+        case TYPE_Bitset:
           iter = TYPE_Int;
           break;
 
         case TYPE_Vector:
         case TYPE_Dict:
+        case TYPE_Set:
+        case TYPE_Deque:
+        case TYPE_PVector:
+        case TYPE_PDict:
           iter = iterable.type_params[0];
           break;
 
@@ -901,6 +1011,8 @@ TypeInfo Sema::check(AST::Base* _ast)
       if (ast->list.empty())
         break;
 
+      this->find_scalar_replaceable(ast);
+
       this->enter_scope(ast);
 
       if (ast->return_last_expr) {
@@ -1058,6 +1170,7 @@ TypeInfo Sema::check(AST::Base* _ast)
       astdef(Struct);
 
       std::map<std::string_view, bool> map;
+      std::vector<TypeInfo> member_types;
 
       for (auto&& item : ast->members) {
         if (!(map[item.name] ^= 1)) {
@@ -1066,9 +1179,11 @@ TypeInfo Sema::check(AST::Base* _ast)
             .exit();
         }
 
-        this->check(item.type);
+        member_types.emplace_back(this->check(item.type));
       }
 
+      ast->layout = StructLayout(member_types);
+
       _ret = TYPE_UserDef;
       _ret.userdef_type = ast;
 
@@ -1121,6 +1236,12 @@ TypeInfo Sema::check(AST::Base* _ast)
 
         case TYPE_Vector:
         case TYPE_Dict:
+        case TYPE_Set:
+        case TYPE_Deque:
+        case TYPE_Heap:
+        case TYPE_NdArray:
+        case TYPE_PVector:
+        case TYPE_PDict:
           if (ast->parameters.empty())
             Error(ast, "missing parameters").emit().exit();
 
@@ -1133,6 +1254,13 @@ TypeInfo Sema::check(AST::Base* _ast)
         ret.type_params.emplace_back(this->check(sub));
       }
 
+      //
+      // n 次元配列の要素は int か float のみ
+      if (ret.kind == TYPE_NdArray && ret.type_params[0].kind != TYPE_Int &&
+          ret.type_params[0].kind != TYPE_Float) {
+        Error(ast->parameters[0], "expected 'int' or 'float'").emit().exit();
+      }
+
       //
       // is_const
       ret.is_const = ast->is_const;
@@ -1181,6 +1309,9 @@ TypeInfo Sema::check_function_call(AST::CallFunc* ast, bool have_self,
     ast->is_builtin = true;
     ast->builtin_func = result.builtin;
 
+    if (result.builtin->result_type_of)
+      return result.builtin->result_type_of(self.value());
+
     return result.builtin->result_type;
   }
 
@@ -1228,6 +1359,22 @@ std::optional<TypeInfo> Sema::is_valid_expr(AST::ExprKind kind,
   if (lhs.equals(TYPE_None) || rhs.equals(TYPE_None))
     return std::nullopt;
 
+  //
+  // n 次元配列
+  //  --> 同じ型の配列、または要素の型の値との四則演算 (要素ごと)
+  if (lhs.kind == TYPE_NdArray) {
+    switch (kind) {
+      case AST::EX_Add:
+      case AST::EX_Sub:
+      case AST::EX_Mul:
+      case AST::EX_Div:
+        if (lhs.equals(rhs) || lhs.type_params[0].equals(rhs))
+          return lhs;
+    }
+
+    return std::nullopt;
+  }
+
   switch (kind) {
     //
     // add
@@ -1,3 +1,5 @@
+#include <algorithm>
+
 #include "Utils.h"
 #include "Debug.h"
 
@@ -188,6 +190,14 @@ void Sema::expect_lvalue(AST::Base* _ast)
 
       this->expect_lvalue(ast->expr);
 
+      // 部分文字列・部分ベクタは、元のものとは別のオブジェクト
+      for (auto&& index : ast->indexes) {
+        if (index.kind == AST::IndexRef::Subscript::SUB_Index &&
+            index.ast->kind == AST_Range) {
+          Error(index.ast, "cannot assign to a slice").emit().exit();
+        }
+      }
+
       break;
     }
 
@@ -205,7 +215,29 @@ std::tuple<Sema::LocalVar*, size_t, size_t> Sema::find_variable(
   {
     for_indexed(index, var, scope.lvar.variables)
     {
-      if (var.name == name)
+      if (var.name == name && !var.is_scalar_member)
+        return {&var, step, index};
+    }
+  }
+
+  return {};
+}
+
+std::tuple<Sema::LocalVar*, size_t, size_t> Sema::find_scalar_member(
+  std::string_view const& name, std::string_view const& member)
+{
+  for_indexed(step, scope, this->scope_list)
+  {
+    for_indexed(index, var, scope.lvar.variables)
+    {
+      if (var.name != name)
+        continue;
+
+      // 同じ名前の普通の変数が先に見つかった
+      if (!var.is_scalar_member)
+        return {};
+
+      if (var.member == member)
         return {&var, step, index};
     }
   }
@@ -213,6 +245,74 @@ std::tuple<Sema::LocalVar*, size_t, size_t> Sema::find_variable(
   return {};
 }
 
+//
+// スカラー置換できる変数を探す
+//
+// 構造体を初期値とする変数で、以降の使用箇所がすべて
+// メンバアクセス (x.member) であれば、構造体のオブジェクトを作らずに
+// メンバごとに別の変数として確保する
+void Sema::find_scalar_replaceable(AST::Scope* scope)
+{
+  using SubscriptKind = AST::IndexRef::Subscript::Kind;
+
+  for (auto it = scope->list.begin(); it != scope->list.end(); it++) {
+    auto let = (AST::VariableDeclaration*)*it;
+
+    if (let->kind != AST_Let || !let->init ||
+        let->init->kind != AST_StructConstructor)
+      continue;
+
+    size_t uses = 0;
+    size_t member_refs = 0;
+    bool redefined = false;
+
+    // メンバ名として書かれている変数 (数えない)
+    std::vector<AST::Base*> member_names;
+
+    for (auto x = std::next(it); x != scope->list.end() && !redefined; x++) {
+      ASTWalker::walk(*x, [&](AST::Base* ast) -> bool {
+        switch (ast->kind) {
+          case AST_Let:
+            if (((AST::VariableDeclaration*)ast)->name == let->name) {
+              redefined = true;
+              return false;
+            }
+
+            break;
+
+          case AST_IndexRef: {
+            auto ref = (AST::IndexRef*)ast;
+
+            for (auto&& sub : ref->indexes)
+              if (sub.kind == SubscriptKind::SUB_Member)
+                member_names.emplace_back(sub.ast);
+
+            if (ref->expr->kind == AST_Variable &&
+                ((AST::Variable*)ref->expr)->name == let->name &&
+                !ref->indexes.empty() &&
+                ref->indexes[0].kind == SubscriptKind::SUB_Member)
+              member_refs++;
+
+            break;
+          }
+
+          case AST_Variable:
+            if (((AST::Variable*)ast)->name == let->name &&
+                std::find(member_names.begin(), member_names.end(), ast) ==
+                  member_names.end())
+              uses++;
+
+            break;
+        }
+
+        return true;
+      });
+    }
+
+    let->is_scalar_replaced = !redefined && uses == member_refs;
+  }
+}
+
 //
 // キャプチャ追加
 void Sema::begin_capture(Sema::CaptureFunction cap_func)
@@ -117,6 +117,24 @@ TypeInfo Sema::expect(TypeInfo const& expected, AST::Base* ast)
 {
   auto type = this->check(ast);
 
+  //
+  // 代入先の型で作成する組み込み関数 (with_capacity)
+  //  --> 期待される型をそのまま使う
+  if (ast->kind == AST_CallFunc) {
+    auto cf = (AST::CallFunc*)ast;
+
+    if (cf->is_builtin && cf->builtin_func->use_expected_type) {
+      if (expected.kind != TYPE_Vector && expected.kind != TYPE_Dict) {
+        Error(ast, "cannot create '" + expected.to_string() + "' with '" +
+                     cf->builtin_func->name + "'")
+          .emit()
+          .exit();
+      }
+
+      return this->value_type_cache[ast] = expected;
+    }
+  }
+
   // 同じならそのまま返す
   if (expected.equals(type))
     return expected;
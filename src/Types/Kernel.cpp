@@ -0,0 +1,1005 @@
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "Kernel.h"
+
+#if defined(__x86_64__)
+#define METRO_KERNEL_AVX2 1
+#define METRO_KERNEL_SSE2 1
+#include <immintrin.h>
+#endif
+
+// ------------------------------------------------
+//  スカラー版
+//
+//  AVX2 が使えないときと、配列の端数の処理に使う
+// ------------------------------------------------
+
+template <class T>
+static T sum_scalar(T const* p, size_t n)
+{
+  T s = 0;
+
+  for (size_t i = 0; i < n; i++)
+    s += p[i];
+
+  return s;
+}
+
+template <class T>
+static T min_scalar(T const* p, size_t n)
+{
+  T m = p[0];
+
+  for (size_t i = 1; i < n; i++)
+    m = std::min(m, p[i]);
+
+  return m;
+}
+
+template <class T>
+static T max_scalar(T const* p, size_t n)
+{
+  T m = p[0];
+
+  for (size_t i = 1; i < n; i++)
+    m = std::max(m, p[i]);
+
+  return m;
+}
+
+template <class T>
+static T dot_scalar(T const* a, T const* b, size_t n)
+{
+  T s = 0;
+
+  for (size_t i = 0; i < n; i++)
+    s += a[i] * b[i];
+
+  return s;
+}
+
+template <class T>
+static void scale_scalar(T* p, size_t n, T k)
+{
+  for (size_t i = 0; i < n; i++)
+    p[i] *= k;
+}
+
+template <class T>
+static void add_scalar(T* dest, T const* src, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    dest[i] += src[i];
+}
+
+template <class T>
+static void fill_scalar(T* p, size_t n, T value)
+{
+  for (size_t i = 0; i < n; i++)
+    p[i] = value;
+}
+
+template <class T>
+static size_t count_scalar(T const* p, size_t n, T value)
+{
+  size_t c = 0;
+
+  for (size_t i = 0; i < n; i++)
+    c += p[i] == value;
+
+  return c;
+}
+
+template <class T>
+static int64_t index_of_scalar(T const* p, size_t n, T value)
+{
+  for (size_t i = 0; i < n; i++)
+    if (p[i] == value)
+      return i;
+
+  return -1;
+}
+
+#if METRO_KERNEL_AVX2
+
+// ------------------------------------------------
+//  AVX2 版
+//
+//  int は 4 要素, float は 8 要素ずつ処理する
+//  AVX2 には 64 ビット整数の乗算がないので、dot(int) と scale(int) は
+//  スカラー版をこの関数の中で展開させて、コンパイラに任せる
+// ------------------------------------------------
+
+#define AVX2 __attribute__((target("avx2")))
+
+static bool has_avx2()
+{
+  static bool const ret = __builtin_cpu_supports("avx2");
+  return ret;
+}
+
+AVX2 static int64_t hsum(__m256i v)
+{
+  alignas(32) int64_t tmp[4];
+
+  _mm256_store_si256((__m256i*)tmp, v);
+
+  return tmp[0] + tmp[1] + tmp[2] + tmp[3];
+}
+
+AVX2 static float hsum(__m256 v)
+{
+  auto x = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+
+  x = _mm_add_ps(x, _mm_movehl_ps(x, x));
+  x = _mm_add_ss(x, _mm_shuffle_ps(x, x, 1));
+
+  return _mm_cvtss_f32(x);
+}
+
+AVX2 static int64_t sum_avx2(int64_t const* p, size_t n)
+{
+  auto acc = _mm256_setzero_si256();
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4)
+    acc = _mm256_add_epi64(acc, _mm256_loadu_si256((__m256i const*)(p + i)));
+
+  return hsum(acc) + sum_scalar(p + i, n - i);
+}
+
+AVX2 static float sum_avx2(float const* p, size_t n)
+{
+  auto acc = _mm256_setzero_ps();
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    acc = _mm256_add_ps(acc, _mm256_loadu_ps(p + i));
+
+  return hsum(acc) + sum_scalar(p + i, n - i);
+}
+
+AVX2 static int64_t min_avx2(int64_t const* p, size_t n)
+{
+  if (n < 4)
+    return min_scalar(p, n);
+
+  auto acc = _mm256_loadu_si256((__m256i const*)p);
+  size_t i = 4;
+
+  for (; i + 4 <= n; i += 4) {
+    auto x = _mm256_loadu_si256((__m256i const*)(p + i));
+    acc = _mm256_blendv_epi8(acc, x, _mm256_cmpgt_epi64(acc, x));
+  }
+
+  alignas(32) int64_t tmp[4];
+  _mm256_store_si256((__m256i*)tmp, acc);
+
+  auto m = min_scalar(tmp, 4);
+
+  return i < n ? std::min(m, min_scalar(p + i, n - i)) : m;
+}
+
+AVX2 static int64_t max_avx2(int64_t const* p, size_t n)
+{
+  if (n < 4)
+    return max_scalar(p, n);
+
+  auto acc = _mm256_loadu_si256((__m256i const*)p);
+  size_t i = 4;
+
+  for (; i + 4 <= n; i += 4) {
+    auto x = _mm256_loadu_si256((__m256i const*)(p + i));
+    acc = _mm256_blendv_epi8(acc, x, _mm256_cmpgt_epi64(x, acc));
+  }
+
+  alignas(32) int64_t tmp[4];
+  _mm256_store_si256((__m256i*)tmp, acc);
+
+  auto m = max_scalar(tmp, 4);
+
+  return i < n ? std::max(m, max_scalar(p + i, n - i)) : m;
+}
+
+AVX2 static float min_avx2(float const* p, size_t n)
+{
+  if (n < 8)
+    return min_scalar(p, n);
+
+  auto acc = _mm256_loadu_ps(p);
+  size_t i = 8;
+
+  for (; i + 8 <= n; i += 8)
+    acc = _mm256_min_ps(acc, _mm256_loadu_ps(p + i));
+
+  alignas(32) float tmp[8];
+  _mm256_store_ps(tmp, acc);
+
+  auto m = min_scalar(tmp, 8);
+
+  return i < n ? std::min(m, min_scalar(p + i, n - i)) : m;
+}
+
+AVX2 static float max_avx2(float const* p, size_t n)
+{
+  if (n < 8)
+    return max_scalar(p, n);
+
+  auto acc = _mm256_loadu_ps(p);
+  size_t i = 8;
+
+  for (; i + 8 <= n; i += 8)
+    acc = _mm256_max_ps(acc, _mm256_loadu_ps(p + i));
+
+  alignas(32) float tmp[8];
+  _mm256_store_ps(tmp, acc);
+
+  auto m = max_scalar(tmp, 8);
+
+  return i < n ? std::max(m, max_scalar(p + i, n - i)) : m;
+}
+
+AVX2 static int64_t dot_avx2(int64_t const* a, int64_t const* b, size_t n)
+{
+  return dot_scalar(a, b, n);
+}
+
+AVX2 static float dot_avx2(float const* a, float const* b, size_t n)
+{
+  auto acc = _mm256_setzero_ps();
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    acc = _mm256_add_ps(
+      acc, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+
+  return hsum(acc) + dot_scalar(a + i, b + i, n - i);
+}
+
+AVX2 static void scale_avx2(int64_t* p, size_t n, int64_t k)
+{
+  scale_scalar(p, n, k);
+}
+
+AVX2 static void scale_avx2(float* p, size_t n, float k)
+{
+  auto vk = _mm256_set1_ps(k);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(p + i, _mm256_mul_ps(_mm256_loadu_ps(p + i), vk));
+
+  scale_scalar(p + i, n - i, k);
+}
+
+AVX2 static void add_avx2(int64_t* dest, int64_t const* src, size_t n)
+{
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4) {
+    auto d = (__m256i*)(dest + i);
+
+    _mm256_storeu_si256(
+      d, _mm256_add_epi64(_mm256_loadu_si256(d),
+                          _mm256_loadu_si256((__m256i const*)(src + i))));
+  }
+
+  add_scalar(dest + i, src + i, n - i);
+}
+
+AVX2 static void add_avx2(float* dest, float const* src, size_t n)
+{
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(dest + i, _mm256_add_ps(_mm256_loadu_ps(dest + i),
+                                             _mm256_loadu_ps(src + i)));
+
+  add_scalar(dest + i, src + i, n - i);
+}
+
+AVX2 static void fill_avx2(int64_t* p, size_t n, int64_t value)
+{
+  auto v = _mm256_set1_epi64x(value);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_si256((__m256i*)(p + i), v);
+
+  fill_scalar(p + i, n - i, value);
+}
+
+AVX2 static void fill_avx2(float* p, size_t n, float value)
+{
+  auto v = _mm256_set1_ps(value);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_ps(p + i, v);
+
+  fill_scalar(p + i, n - i, value);
+}
+
+//
+// 一致した要素のビットを立てたマスク
+AVX2 static unsigned eq_mask(int64_t const* p, __m256i v)
+{
+  auto cmp = _mm256_cmpeq_epi64(_mm256_loadu_si256((__m256i const*)p), v);
+  return _mm256_movemask_pd(_mm256_castsi256_pd(cmp));
+}
+
+AVX2 static unsigned eq_mask(float const* p, __m256 v)
+{
+  return _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(p), v, _CMP_EQ_OQ));
+}
+
+AVX2 static size_t count_avx2(int64_t const* p, size_t n, int64_t value)
+{
+  auto v = _mm256_set1_epi64x(value);
+  size_t c = 0;
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4)
+    c += __builtin_popcount(eq_mask(p + i, v));
+
+  return c + count_scalar(p + i, n - i, value);
+}
+
+AVX2 static size_t count_avx2(float const* p, size_t n, float value)
+{
+  auto v = _mm256_set1_ps(value);
+  size_t c = 0;
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    c += __builtin_popcount(eq_mask(p + i, v));
+
+  return c + count_scalar(p + i, n - i, value);
+}
+
+AVX2 static int64_t index_of_avx2(int64_t const* p, size_t n, int64_t value)
+{
+  auto v = _mm256_set1_epi64x(value);
+  size_t i = 0;
+
+  for (; i + 4 <= n; i += 4)
+    if (auto mask = eq_mask(p + i, v); mask)
+      return i + __builtin_ctz(mask);
+
+  auto r = index_of_scalar(p + i, n - i, value);
+
+  return r < 0 ? -1 : (int64_t)i + r;
+}
+
+AVX2 static int64_t index_of_avx2(float const* p, size_t n, float value)
+{
+  auto v = _mm256_set1_ps(value);
+  size_t i = 0;
+
+  for (; i + 8 <= n; i += 8)
+    if (auto mask = eq_mask(p + i, v); mask)
+      return i + __builtin_ctz(mask);
+
+  auto r = index_of_scalar(p + i, n - i, value);
+
+  return r < 0 ? -1 : (int64_t)i + r;
+}
+
+#define DISPATCH(Name, Args...) \
+  if (has_avx2())               \
+    return Name##_avx2(Args);   \
+  return Name##_scalar(Args)
+
+#else
+
+#define DISPATCH(Name, Args...) return Name##_scalar(Args)
+
+#endif  // METRO_KERNEL_AVX2
+
+// ------------------------------------------------
+//  行列の積
+//
+//  BlockSize 四方のブロックごとに計算して、a, b, c の読み書きが
+//  キャッシュに収まるようにする
+//  最も内側のループは c と b の行を連続して読み書きするので、
+//  コンパイラがベクトル化する
+// ------------------------------------------------
+
+static constexpr size_t MatmulBlockSize = 64;
+
+// n * k * m がこれより大きければ、複数のスレッドで計算する
+static constexpr size_t MatmulParallelThreshold = 1 << 21;
+
+//
+// c の begin 行目から end 行目までを計算する
+template <class T>
+static void matmul_rows(T const* a, T const* b, T* c, size_t begin,
+                        size_t end, size_t k, size_t m)
+{
+  constexpr size_t B = MatmulBlockSize;
+
+  std::fill(c + begin * m, c + end * m, T{});
+
+  for (size_t i0 = begin; i0 < end; i0 += B) {
+    auto i1 = std::min(i0 + B, end);
+
+    for (size_t p0 = 0; p0 < k; p0 += B) {
+      auto p1 = std::min(p0 + B, k);
+
+      for (size_t j0 = 0; j0 < m; j0 += B) {
+        auto j1 = std::min(j0 + B, m);
+
+        for (size_t i = i0; i < i1; i++) {
+          auto cr = c + i * m;
+
+          for (size_t p = p0; p < p1; p++) {
+            auto x = a[i * k + p];
+            auto br = b + p * m;
+
+            for (size_t j = j0; j < j1; j++)
+              cr[j] += x * br[j];
+          }
+        }
+      }
+    }
+  }
+}
+
+template <class T>
+static void matmul_impl(T const* a, T const* b, T* c, size_t n, size_t k,
+                        size_t m)
+{
+  size_t threads = std::thread::hardware_concurrency();
+
+  if (n * k * m < MatmulParallelThreshold || threads <= 1 || n < 2) {
+    matmul_rows(a, b, c, 0, n, k, m);
+    return;
+  }
+
+  auto chunk = (n + std::min(threads, n) - 1) / std::min(threads, n);
+
+  std::vector<std::thread> workers;
+
+  for (size_t begin = chunk; begin < n; begin += chunk)
+    workers.emplace_back(matmul_rows<T>, a, b, c, begin,
+                         std::min(begin + chunk, n), k, m);
+
+  matmul_rows(a, b, c, 0, chunk, k, m);
+
+  for (auto&& t : workers)
+    t.join();
+}
+
+// ------------------------------------------------
+//  ビット列
+//
+//  語ごとの論理演算は、コンパイラが SSE2 でベクトル化する
+//  popcount は POPCNT 命令があればそれを使う
+// ------------------------------------------------
+
+static size_t popcount_scalar(uint64_t const* p, size_t n)
+{
+  size_t c = 0;
+
+  for (size_t i = 0; i < n; i++)
+    c += __builtin_popcountll(p[i]);
+
+  return c;
+}
+
+#if defined(__x86_64__)
+
+__attribute__((target("popcnt"))) static size_t popcount_popcnt(
+  uint64_t const* p, size_t n)
+{
+  size_t c = 0;
+
+  for (size_t i = 0; i < n; i++)
+    c += __builtin_popcountll(p[i]);
+
+  return c;
+}
+
+static bool has_popcnt()
+{
+  static bool const ret = __builtin_cpu_supports("popcnt");
+  return ret;
+}
+
+#endif
+
+// ------------------------------------------------
+//  部分文字列の検索
+//
+//  needle の最初と最後の文字が一致する位置を SSE2 で 8 文字ずつ探し、
+//  候補だけを memcmp で比べる
+//  (x86-64 では SSE2 は常に使える)
+// ------------------------------------------------
+
+static int64_t find_scalar(metro_char_t const* hay, size_t n,
+                           metro_char_t const* needle, size_t m, size_t i)
+{
+  for (; i + m <= n; i++) {
+    if (hay[i] == needle[0] &&
+        memcmp(hay + i, needle, m * sizeof(metro_char_t)) == 0)
+      return i;
+  }
+
+  return -1;
+}
+
+#if METRO_KERNEL_SSE2
+
+static int64_t find_sse2(metro_char_t const* hay, size_t n,
+                         metro_char_t const* needle, size_t m)
+{
+  auto first = _mm_set1_epi16(needle[0]);
+  auto last = _mm_set1_epi16(needle[m - 1]);
+
+  size_t i = 0;
+
+  for (; i + m - 1 + 8 <= n; i += 8) {
+    auto block_first = _mm_loadu_si128((__m128i const*)(hay + i));
+    auto block_last = _mm_loadu_si128((__m128i const*)(hay + i + m - 1));
+
+    auto eq = _mm_and_si128(_mm_cmpeq_epi16(first, block_first),
+                            _mm_cmpeq_epi16(last, block_last));
+
+    // 16 ビットごとに 2 ビット立つ
+    unsigned mask = _mm_movemask_epi8(eq);
+
+    while (mask) {
+      auto pos = __builtin_ctz(mask) / 2;
+
+      if (memcmp(hay + i + pos + 1, needle + 1,
+                 (m - 1) * sizeof(metro_char_t)) == 0)
+        return i + pos;
+
+      mask &= ~(3u << (pos * 2));
+    }
+  }
+
+  return find_scalar(hay, n, needle, m, i);
+}
+
+#endif  // METRO_KERNEL_SSE2
+
+// ------------------------------------------------
+//  UTF-8 と UTF-16 の変換
+//
+//  ASCII が続く部分は SSE2 で 16 文字ずつ変換し、
+//  それ以外の文字だけを 1 文字ずつ処理する
+// ------------------------------------------------
+
+static constexpr metro_char_t ReplacementChar = 0xFFFD;
+
+static bool is_high_surrogate(uint32_t c)
+{
+  return (c & 0xFC00) == 0xD800;
+}
+
+static bool is_low_surrogate(uint32_t c)
+{
+  return (c & 0xFC00) == 0xDC00;
+}
+
+#if METRO_KERNEL_SSE2
+
+//
+// p から 16 バイトがすべて ASCII か
+static bool is_ascii16(unsigned char const* p)
+{
+  return _mm_movemask_epi8(_mm_loadu_si128((__m128i const*)p)) == 0;
+}
+
+//
+// p から 16 文字がすべて ASCII か
+static bool is_ascii16(metro_char_t const* p)
+{
+  auto v = _mm_or_si128(_mm_loadu_si128((__m128i const*)p),
+                        _mm_loadu_si128((__m128i const*)(p + 8)));
+
+  return _mm_movemask_epi8(_mm_cmpeq_epi16(
+           _mm_and_si128(v, _mm_set1_epi16((short)0xFF80)),
+           _mm_setzero_si128())) == 0xFFFF;
+}
+
+#endif  // METRO_KERNEL_SSE2
+
+//
+// s[i] から始まる UTF-8 の 1 文字を読む
+// 不正なバイト列であれば ReplacementChar を返し、読み飛ばすバイト数を len に入れる
+//
+// 読み飛ばすのは正しい並びの先頭として読める最長の部分 (maximal subpart) なので、
+// 途中で切れた 3・4 バイトの並びは一つの U+FFFD に、冗長な表現やサロゲートは
+// 先頭のバイトから一つずつ U+FFFD になる (Unicode 3.9, Table 3-7)
+static uint32_t decode_utf8(unsigned char const* s, size_t n, size_t i,
+                            size_t& len)
+{
+  auto c = s[i];
+  uint32_t cp;
+  size_t trail;
+
+  // 2 バイト目に許される範囲
+  unsigned char lo = 0x80, hi = 0xBF;
+
+  len = 1;
+
+  if (c >= 0xC2 && c <= 0xDF) {
+    trail = 1, cp = c & 0x1F;
+  }
+  else if (c >= 0xE0 && c <= 0xEF) {
+    trail = 2, cp = c & 0x0F;
+
+    if (c == 0xE0)
+      lo = 0xA0;  // 冗長な表現
+    else if (c == 0xED)
+      hi = 0x9F;  // サロゲート
+  }
+  else if (c >= 0xF0 && c <= 0xF4) {
+    trail = 3, cp = c & 0x07;
+
+    if (c == 0xF0)
+      lo = 0x90;  // 冗長な表現
+    else if (c == 0xF4)
+      hi = 0x8F;  // U+10FFFF を超える
+  }
+  else {
+    return ReplacementChar;
+  }
+
+  for (; trail > 0; trail--) {
+    if (i + len >= n || s[i + len] < lo || s[i + len] > hi)
+      return ReplacementChar;
+
+    cp = (cp << 6) | (s[i + len++] & 0x3F);
+    lo = 0x80, hi = 0xBF;
+  }
+
+  return cp;
+}
+
+namespace Kernel {
+
+size_t utf8_to_utf16(char const* src, size_t n, metro_char_t* dest)
+{
+  auto s = (unsigned char const*)src;
+  auto d = dest;
+  size_t i = 0;
+
+  while (i < n) {
+#if METRO_KERNEL_SSE2
+    auto zero = _mm_setzero_si128();
+
+    for (; i + 16 <= n && is_ascii16(s + i); i += 16, d += 16) {
+      auto v = _mm_loadu_si128((__m128i const*)(s + i));
+
+      _mm_storeu_si128((__m128i*)d, _mm_unpacklo_epi8(v, zero));
+      _mm_storeu_si128((__m128i*)(d + 8), _mm_unpackhi_epi8(v, zero));
+    }
+
+    if (i >= n)
+      break;
+#endif
+
+    if (s[i] < 0x80) {
+      *d++ = s[i++];
+      continue;
+    }
+
+    size_t len;
+    auto cp = decode_utf8(s, n, i, len);
+
+    if (cp >= 0x10000) {
+      cp -= 0x10000;
+      *d++ = 0xD800 | (cp >> 10);
+      *d++ = 0xDC00 | (cp & 0x3FF);
+    }
+    else {
+      *d++ = cp;
+    }
+
+    i += len;
+  }
+
+  return d - dest;
+}
+
+size_t utf16_to_utf8(metro_char_t const* src, size_t n, char* dest)
+{
+  auto d = (unsigned char*)dest;
+  size_t i = 0;
+
+  while (i < n) {
+#if METRO_KERNEL_SSE2
+    for (; i + 16 <= n && is_ascii16(src + i); i += 16, d += 16) {
+      _mm_storeu_si128(
+        (__m128i*)d,
+        _mm_packus_epi16(_mm_loadu_si128((__m128i const*)(src + i)),
+                         _mm_loadu_si128((__m128i const*)(src + i + 8))));
+    }
+
+    if (i >= n)
+      break;
+#endif
+
+    uint32_t c = src[i++];
+
+    if (c < 0x80) {
+      *d++ = c;
+      continue;
+    }
+
+    if (c < 0x800) {
+      *d++ = 0xC0 | (c >> 6);
+      *d++ = 0x80 | (c & 0x3F);
+      continue;
+    }
+
+    if (is_high_surrogate(c) && i < n && is_low_surrogate(src[i])) {
+      c = 0x10000 + ((c - 0xD800) << 10) + (src[i++] - 0xDC00);
+
+      *d++ = 0xF0 | (c >> 18);
+      *d++ = 0x80 | ((c >> 12) & 0x3F);
+      *d++ = 0x80 | ((c >> 6) & 0x3F);
+      *d++ = 0x80 | (c & 0x3F);
+      continue;
+    }
+
+    // 対になっていないサロゲート
+    if ((c & 0xF800) == 0xD800)
+      c = ReplacementChar;
+
+    *d++ = 0xE0 | (c >> 12);
+    *d++ = 0x80 | ((c >> 6) & 0x3F);
+    *d++ = 0x80 | (c & 0x3F);
+  }
+
+  return (char*)d - dest;
+}
+
+size_t utf8_length(metro_char_t const* p, size_t n)
+{
+  size_t len = 0;
+  size_t i = 0;
+
+  while (i < n) {
+#if METRO_KERNEL_SSE2
+    for (; i + 16 <= n && is_ascii16(p + i); i += 16)
+      len += 16;
+
+    if (i >= n)
+      break;
+#endif
+
+    uint32_t c = p[i++];
+
+    if (c < 0x80)
+      len += 1;
+    else if (c < 0x800)
+      len += 2;
+    else if (is_high_surrogate(c) && i < n && is_low_surrogate(p[i]))
+      len += 4, i++;
+    else
+      len += 3;
+  }
+
+  return len;
+}
+
+bool is_well_formed(metro_char_t const* p, size_t n)
+{
+  size_t i = 0;
+
+  while (i < n) {
+#if METRO_KERNEL_SSE2
+    // サロゲートを含まない 8 文字は読み飛ばす
+    for (; i + 8 <= n; i += 8) {
+      auto v = _mm_and_si128(_mm_loadu_si128((__m128i const*)(p + i)),
+                             _mm_set1_epi16((short)0xF800));
+
+      if (_mm_movemask_epi8(
+            _mm_cmpeq_epi16(v, _mm_set1_epi16((short)0xD800))))
+        break;
+    }
+
+    if (i >= n)
+      break;
+#endif
+
+    uint32_t c = p[i++];
+
+    if (is_high_surrogate(c)) {
+      if (i >= n || !is_low_surrogate(p[i]))
+        return false;
+
+      i++;
+    }
+    else if (is_low_surrogate(c)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+int64_t find(metro_char_t const* hay, size_t n, metro_char_t const* needle,
+             size_t m)
+{
+  if (m == 0)
+    return 0;
+
+  if (m > n)
+    return -1;
+
+#if METRO_KERNEL_SSE2
+  return find_sse2(hay, n, needle, m);
+#else
+  return find_scalar(hay, n, needle, m, 0);
+#endif
+}
+
+int64_t sum(int64_t const* p, size_t n)
+{
+  DISPATCH(sum, p, n);
+}
+
+float sum(float const* p, size_t n)
+{
+  DISPATCH(sum, p, n);
+}
+
+int64_t min(int64_t const* p, size_t n)
+{
+  DISPATCH(min, p, n);
+}
+
+float min(float const* p, size_t n)
+{
+  DISPATCH(min, p, n);
+}
+
+int64_t max(int64_t const* p, size_t n)
+{
+  DISPATCH(max, p, n);
+}
+
+float max(float const* p, size_t n)
+{
+  DISPATCH(max, p, n);
+}
+
+int64_t dot(int64_t const* a, int64_t const* b, size_t n)
+{
+  DISPATCH(dot, a, b, n);
+}
+
+float dot(float const* a, float const* b, size_t n)
+{
+  DISPATCH(dot, a, b, n);
+}
+
+void scale(int64_t* p, size_t n, int64_t k)
+{
+  DISPATCH(scale, p, n, k);
+}
+
+void scale(float* p, size_t n, float k)
+{
+  DISPATCH(scale, p, n, k);
+}
+
+void add(int64_t* dest, int64_t const* src, size_t n)
+{
+  DISPATCH(add, dest, src, n);
+}
+
+void add(float* dest, float const* src, size_t n)
+{
+  DISPATCH(add, dest, src, n);
+}
+
+void fill(int64_t* p, size_t n, int64_t value)
+{
+  DISPATCH(fill, p, n, value);
+}
+
+void fill(float* p, size_t n, float value)
+{
+  DISPATCH(fill, p, n, value);
+}
+
+size_t count(int64_t const* p, size_t n, int64_t value)
+{
+  DISPATCH(count, p, n, value);
+}
+
+size_t count(float const* p, size_t n, float value)
+{
+  DISPATCH(count, p, n, value);
+}
+
+int64_t index_of(int64_t const* p, size_t n, int64_t value)
+{
+  DISPATCH(index_of, p, n, value);
+}
+
+int64_t index_of(float const* p, size_t n, float value)
+{
+  DISPATCH(index_of, p, n, value);
+}
+
+void sub(int64_t* dest, int64_t const* src, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    dest[i] -= src[i];
+}
+
+void sub(float* dest, float const* src, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    dest[i] -= src[i];
+}
+
+void mul(int64_t* dest, int64_t const* src, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    dest[i] *= src[i];
+}
+
+void mul(float* dest, float const* src, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    dest[i] *= src[i];
+}
+
+void matmul(int64_t const* a, int64_t const* b, int64_t* c, size_t n,
+            size_t k, size_t m)
+{
+  matmul_impl(a, b, c, n, k, m);
+}
+
+void matmul(float const* a, float const* b, float* c, size_t n, size_t k,
+            size_t m)
+{
+  matmul_impl(a, b, c, n, k, m);
+}
+
+size_t popcount(uint64_t const* p, size_t n)
+{
+#if defined(__x86_64__)
+  if (has_popcnt())
+    return popcount_popcnt(p, n);
+#endif
+
+  return popcount_scalar(p, n);
+}
+
+void bit_and(uint64_t* dest, uint64_t const* src, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    dest[i] &= src[i];
+}
+
+void bit_or(uint64_t* dest, uint64_t const* src, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    dest[i] |= src[i];
+}
+
+void bit_xor(uint64_t* dest, uint64_t const* src, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    dest[i] ^= src[i];
+}
+
+void bit_not(uint64_t* p, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    p[i] = ~p[i];
+}
+
+}  // namespace Kernel
@@ -1,12 +1,19 @@
+#include <algorithm>
+#include <bit>
 #include <cassert>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <iterator>
 #include <map>
+#include <unordered_map>
 
 #include "Utils.h"
 #include "Debug.h"
 
 #include "Token.h"
 #include "Object/Object.h"
+#include "Kernel.h"
 
 #include "AST/AST.h"
 
@@ -16,6 +23,55 @@
 
 static bool nested = 0;
 
+//
+// ハッシュ値の下位ビットを使うので、全体のビットを混ぜる
+static size_t mix_hash(size_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+
+  return h;
+}
+
+//
+// 要素の型に対応する C++ の型で f<T>() を呼ぶ
+template <class F>
+static void with_scalar_type(TypeKind kind, F&& f)
+{
+  switch (kind) {
+    case TYPE_Int:
+      return f.template operator()<int64_t>();
+
+    case TYPE_USize:
+      return f.template operator()<size_t>();
+
+    case TYPE_Float:
+      return f.template operator()<float>();
+
+    case TYPE_Bool:
+      return f.template operator()<bool>();
+
+    case TYPE_Char:
+      return f.template operator()<metro_char_t>();
+  }
+
+  panic("not inline type: %d", kind);
+}
+
+//
+// NaN は最も大きいものとする (Object::compare と同じ)
+template <class T>
+static bool less_raw(T a, T b)
+{
+  if constexpr (std::is_floating_point_v<T>) {
+    if (std::isnan(a) || std::isnan(b))
+      return !std::isnan(a) && std::isnan(b);
+  }
+
+  return a < b;
+}
+
 bool Object::equals(Object* object) const
 {
 #define eeeee(A, B) \
@@ -36,17 +92,395 @@ bool Object::equals(Object* object) const
     ajjja(Bool);
     ajjja(Char);
     ajjja(String);
+    ajjja(StringBuilder);
     ajjja(Dict);
+    ajjja(Set);
+    ajjja(Deque);
+    ajjja(Heap);
+    ajjja(Bitset);
+    ajjja(NdArray);
+    ajjja(PVector);
+    ajjja(PDict);
     ajjja(Vector);
     ajjja(Enumerator);
 
+    eeeee(UserDef, UserType);
+
+    case TYPE_None:
+      return true;
+  }
+
+  todo_impl;
+}
+
+size_t Object::hash() const
+{
+  switch (this->type.kind) {
     case TYPE_None:
+      return 0;
+
+    case TYPE_Int:
+      return std::hash<int64_t>{}(((ObjLong*)this)->value);
+
+    case TYPE_USize:
+      return std::hash<size_t>{}(((ObjUSize*)this)->value);
+
+    case TYPE_Float: {
+      auto value = ((ObjFloat*)this)->value;
+
+      // 0.0 == -0.0
+      return value == 0 ? 0 : std::hash<float>{}(value);
+    }
+
+    case TYPE_Bool:
+      return ((ObjBool*)this)->value;
+
+    case TYPE_Char:
+      return std::hash<metro_char_t>{}(((ObjChar*)this)->value);
+
+    case TYPE_String:
+      return ((ObjString*)this)->hash();
+
+    case TYPE_Set: {
+      // 順序によらない値にする
+      size_t h = ((ObjSet*)this)->size();
+
+      for (auto&& item : ((ObjSet*)this)->items)
+        if (!item.is_removed())
+          h += mix_hash(item.hash);
+
+      return h;
+    }
+
+    case TYPE_Deque: {
+      auto deq = (ObjDeque*)this;
+      size_t h = deq->size();
+
+      for (size_t i = 0; i < deq->size(); i++)
+        h = h * 31 + deq->at(i)->hash();
+
+      return h;
+    }
+
+    case TYPE_Heap: {
+      // 順序によらない値にする
+      auto heap = (ObjHeap*)this;
+      size_t h = heap->size();
+
+      if (heap->is_scalar) {
+        with_scalar_type(heap->type.type_params[0].kind, [&]<class T>() {
+          auto p = (T const*)heap->values.data();
+
+          // 0.0 == -0.0
+          for (size_t i = 0; i < heap->size(); i++)
+            h += mix_hash(std::hash<T>{}(p[i] == T{} ? T{} : p[i]));
+        });
+      }
+      else {
+        for (auto&& e : heap->elements)
+          h += mix_hash(e->hash());
+      }
+
+      return h;
+    }
+
+    case TYPE_Bitset: {
+      auto bits = (ObjBitset*)this;
+      size_t h = bits->length;
+
+      for (auto&& w : bits->words)
+        h = h * 31 + mix_hash(w);
+
+      return h;
+    }
+
+    case TYPE_NdArray: {
+      auto arr = (ObjNdArray*)this;
+      size_t h = arr->size();
+
+      with_scalar_type(arr->elem_kind(), [&]<class T>() {
+        auto p = (T const*)arr->buffer->data();
+
+        // 0.0 == -0.0
+        for (size_t i = 0; i < arr->size(); i++) {
+          auto v = p[arr->position(i)];
+          h = h * 31 + std::hash<T>{}(v == T{} ? T{} : v);
+        }
+      });
+
+      return h;
+    }
+
+    case TYPE_PVector: {
+      auto vec = (ObjPVector*)this;
+      size_t h = vec->size();
+
+      for (size_t i = 0; i < vec->size(); i++)
+        h = h * 31 + vec->get(i)->hash();
+
+      return h;
+    }
+
+    case TYPE_PDict: {
+      // 順序によらない値にする
+      auto dict = (ObjPDict*)this;
+      size_t h = dict->size();
+
+      for (auto&& [key, value] : dict->entries())
+        h += mix_hash(key->hash() * 31 + value->hash());
+
+      return h;
+    }
+
+    case TYPE_StringBuilder:
+      return std::hash<std::u16string_view>{}(
+        ((ObjStringBuilder*)this)->buffer);
+
+    case TYPE_Range: {
+      auto range = (ObjRange*)this;
+      return range->begin * 31 + range->end;
+    }
+
+    case TYPE_Enumerator: {
+      auto e = (ObjEnumerator*)this;
+      return e->index * 31 + (e->value ? e->value->hash() : 0);
+    }
+
+    case TYPE_Vector: {
+      auto vec = (ObjVector*)this;
+      size_t h = vec->size();
+
+      if (vec->is_columnar()) {
+        for (size_t f = 0; f < vec->layout->fields.size(); f++)
+          h = h * 31 + std::hash<std::string_view>{}(vec->column_view(f));
+      }
+      else {
+        for (auto&& e : vec->elements)
+          h = h * 31 + e->hash();
+      }
+
+      return h;
+    }
+
+    case TYPE_UserDef: {
+      auto ut = (ObjUserType*)this;
+      size_t h = 0;
+
+      for (size_t i = 0; i < ut->member_count(); i++) {
+        auto const& field = ut->layout->fields[i];
+
+        // 値を直接持つメンバは equals と同じく、バイト列で比べる
+        if (field.is_inline) {
+          h = h * 31 + std::hash<std::string_view>{}(std::string_view(
+                         (char const*)ut->field_ptr(i),
+                         StructLayout::get_inline_size(field.kind)));
+        }
+        else {
+          h = h * 31 + ut->ref_member(i)->hash();
+        }
+      }
+
+      return h;
+    }
+  }
+
+  todo_impl;
+}
+
+bool Object::is_comparable(TypeKind kind)
+{
+  switch (kind) {
+    case TYPE_Int:
+    case TYPE_USize:
+    case TYPE_Float:
+    case TYPE_Bool:
+    case TYPE_Char:
+    case TYPE_String:
       return true;
   }
 
+  return false;
+}
+
+template <class T>
+static int compare_value(T a, T b)
+{
+  return a < b ? -1 : b < a ? 1 : 0;
+}
+
+int Object::compare(Object* x) const
+{
+  switch (this->type.kind) {
+    case TYPE_Int:
+      return compare_value(((ObjLong*)this)->value, ((ObjLong*)x)->value);
+
+    case TYPE_USize:
+      return compare_value(((ObjUSize*)this)->value, ((ObjUSize*)x)->value);
+
+    case TYPE_Float: {
+      auto a = ((ObjFloat*)this)->value;
+      auto b = ((ObjFloat*)x)->value;
+
+      // NaN は最も大きいものとする
+      if (std::isnan(a) || std::isnan(b))
+        return std::isnan(a) - std::isnan(b);
+
+      return compare_value(a, b);
+    }
+
+    case TYPE_Bool:
+      return compare_value(((ObjBool*)this)->value, ((ObjBool*)x)->value);
+
+    case TYPE_Char:
+      return compare_value(((ObjChar*)this)->value, ((ObjChar*)x)->value);
+
+    case TYPE_String:
+      return ((ObjString*)this)->view().compare(((ObjString*)x)->view());
+  }
+
   todo_impl;
 }
 
+static std::string float_to_string(float value)
+{
+  auto ret = std::to_string(value);
+
+  while (ret.size() > 3 && *ret.rbegin() == '0') {
+    ret.pop_back();
+  }
+
+  return ret;
+}
+
+Object* Object::from_raw(TypeKind kind, void const* p)
+{
+  switch (kind) {
+    case TYPE_Int:
+      return new ObjLong(*(int64_t const*)p);
+
+    case TYPE_USize:
+      return new ObjUSize(*(size_t const*)p);
+
+    case TYPE_Float:
+      return new ObjFloat(*(float const*)p);
+
+    case TYPE_Bool:
+      return new ObjBool(*(bool const*)p);
+
+    case TYPE_Char:
+      return new ObjChar(*(metro_char_t const*)p);
+  }
+
+  panic("not inline type: %d", kind);
+}
+
+void Object::to_raw(TypeKind kind, void* p, Object const* obj)
+{
+  switch (kind) {
+    case TYPE_Int:
+      *(int64_t*)p = ((ObjLong const*)obj)->value;
+      return;
+
+    case TYPE_USize:
+      *(size_t*)p = ((ObjUSize const*)obj)->value;
+      return;
+
+    case TYPE_Float:
+      *(float*)p = ((ObjFloat const*)obj)->value;
+      return;
+
+    case TYPE_Bool:
+      *(bool*)p = ((ObjBool const*)obj)->value;
+      return;
+
+    case TYPE_Char:
+      *(metro_char_t*)p = ((ObjChar const*)obj)->value;
+      return;
+  }
+
+  panic("not inline type: %d", kind);
+}
+
+std::string Object::raw_to_string(TypeKind kind, void const* p)
+{
+  switch (kind) {
+    case TYPE_Int:
+      return std::to_string(*(int64_t const*)p);
+
+    case TYPE_USize:
+      return std::to_string(*(size_t const*)p);
+
+    case TYPE_Float:
+      return float_to_string(*(float const*)p);
+
+    case TYPE_Bool:
+      return *(bool const*)p ? "true" : "false";
+
+    case TYPE_Char:
+      return metro_string_t(1, *(metro_char_t const*)p).to_string();
+  }
+
+  panic("not inline type: %d", kind);
+}
+
+// --------------------------------------------------------
+//  ObjUserType
+// --------------------------------------------------------
+
+ObjUserType* ObjUserType::create(AST::Typeable* ast)
+{
+  StructLayout const* layout = nullptr;
+
+  if (ast->kind == AST_Struct)
+    layout = &((AST::Struct*)ast)->layout;
+
+  size_t size = layout ? layout->size : 0;
+
+  auto ret = ::new (Object::operator new(sizeof(ObjUserType) + size))
+    ObjUserType(ast, layout);
+
+  memset(ret->data(), 0, size);
+
+  return ret;
+}
+
+ObjUserType::~ObjUserType()
+{
+  for (size_t i = 0; i < this->member_count(); i++) {
+    if (!this->is_inline(i) && this->ref_member(i))
+      this->ref_member(i)->ref_count--;
+  }
+}
+
+Object* ObjUserType::get_member(size_t index) const
+{
+  auto const& field = this->layout->fields[index];
+
+  if (field.is_inline)
+    return Object::from_raw(field.kind, this->field_ptr(index));
+
+  return *(Object**)this->field_ptr(index);
+}
+
+void ObjUserType::set_member(size_t index, Object* obj)
+{
+  auto p = this->field_ptr(index);
+  auto const& field = this->layout->fields[index];
+
+  if (field.is_inline) {
+    Object::to_raw(field.kind, p, obj);
+    return;
+  }
+
+  auto& ref = *(Object**)p;
+
+  if (ref)
+    ref->ref_count--;
+
+  ref = obj;
+  ref->ref_count++;
+}
+
 std::string ObjUserType::to_string() const
 {
   auto pStruct = (AST::Struct*)this->type.userdef_type;
@@ -56,10 +490,17 @@ std::string ObjUserType::to_string() const
   auto ns = nested;
   nested = true;
 
-  for (auto pm = pStruct->members.begin(); auto&& member : this->members) {
-    ret += std::string((pm++)->name) + ": " + member->to_string();
+  for (size_t i = 0; i < this->member_count(); i++) {
+    auto p = this->field_ptr(i);
+
+    ret += std::string(pStruct->members[i].name) + ": ";
 
-    if (pm != pStruct->members.end())
+    if (this->is_inline(i))
+      ret += Object::raw_to_string(this->layout->fields[i].kind, p);
+    else
+      ret += (*(Object**)p)->to_string();
+
+    if (i + 1 < this->member_count())
       ret += ", ";
   }
 
@@ -67,6 +508,25 @@ std::string ObjUserType::to_string() const
   return ret + " }";
 }
 
+bool ObjUserType::equals(ObjUserType* x) const
+{
+  for (size_t i = 0; i < this->member_count(); i++) {
+    auto const& field = this->layout->fields[i];
+
+    if (field.is_inline) {
+      if (memcmp(this->field_ptr(i), x->field_ptr(i),
+                 StructLayout::get_inline_size(field.kind)) != 0)
+        return false;
+    }
+    else if (!(*(Object**)this->field_ptr(i))
+                ->equals(*(Object**)x->field_ptr(i))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
 std::string ObjNone::to_string() const
 {
   return "none";
@@ -99,23 +559,17 @@ std::string ObjEnumerator::to_string() const
 
 std::string ObjFloat::to_string() const
 {
-  auto ret = std::to_string(this->value);
-
-  while (ret.size() > 3 && *ret.rbegin() == '0') {
-    ret.pop_back();
-  }
-
-  return ret;
+  return float_to_string(this->value);
 }
 
 std::string ObjChar::to_string() const
 {
-  return Utils::String::to_str(std::wstring(1, this->value));
+  return metro_string_t(1, this->value).to_string();
 }
 
 std::string ObjString::to_string() const
 {
-  auto str = this->get_string().to_string();
+  auto str = metro_string_t::to_string(this->view());
 
   if (nested) {
     return '"' + str + '"';
@@ -124,117 +578,2376 @@ std::string ObjString::to_string() const
   return str;
 }
 
-std::string ObjRange::to_string() const
+std::string ObjStringBuilder::to_string() const
 {
-  return Utils::format("%zd..%zd", this->begin, this->end);
+  return this->buffer.to_string();
 }
 
-std::string ObjDict::to_string() const
-{
-  std::string s = "{";
+// --------------------------------------------------------
+//  ObjString
+// --------------------------------------------------------
 
-  auto nss = nested;
-  nested = 1;
+ObjString& ObjString::append(ObjString* str)
+{
+  if (str->length() == 0)
+    return *this;
 
-  for (auto&& x : this->items) {
-    s += x.key->to_string() + ": " + x.value->to_string();
+  this->interned = nullptr;
 
-    if (&x != &*this->items.rbegin())
-      s += ", ";
+  if (this->length() + str->length() < RopeThreshold) {
+    this->flatten();
+    this->value += str->view();
+  }
+  else if (this->length() == 0) {
+    this->rope = str->as_rope();
+  }
+  else {
+    this->rope = RopeNode::make_concat(this->as_rope(), str->as_rope());
   }
 
-  nested = nss;
-
-  return s + "}";
+  return *this;
 }
 
-std::string ObjVector::to_string() const
+void ObjString::flatten_rope() const
 {
-  std::string s = "[";
+  metro_string_t str;
 
-  auto nss = nested;
-  nested = 1;
-
-  for (auto&& x : this->elements) {
-    s += x->to_string();
-    if (x != *this->elements.rbegin())
-      s += ", ";
+  // 他から参照されていない葉であれば、移すだけでよい
+  if (this->rope->is_leaf() && this->rope.use_count() == 1) {
+    str = std::move(this->rope->leaf);
+  }
+  else {
+    str.reserve(this->rope->length);
+    this->rope->flatten_to(str);
   }
 
-  nested = nss;
-
-  return s + "]";
+  this->value = std::move(str);
+  this->rope.reset();
 }
 
-ObjUserType* ObjUserType::clone() const
+std::shared_ptr<RopeNode> const& ObjString::as_rope() const
 {
-  auto obj = new ObjUserType(this->type.userdef_type);
-
-  for (auto&& member : this->members)
-    obj->add_member(member->clone());
+  if (!this->rope) {
+    this->rope = RopeNode::make_leaf(std::move(this->value));
+    this->value.clear();
+  }
 
-  return obj;
+  return this->rope;
 }
 
-ObjNone* ObjNone::clone() const
+ObjString* ObjString::slice(size_t begin, size_t end) const
 {
-  return new ObjNone;  // ???
-}
+  auto len = end - begin;
 
-ObjLong* ObjLong::clone() const
-{
-  return new ObjLong(this->value);
-}
+  if (len == 0)
+    return new ObjString;
 
-ObjUSize* ObjUSize::clone() const
-{
-  return new ObjUSize(this->value);
-}
+  // 連結された文字列は、一度平坦にしてから参照する
+  if (this->rope && !this->rope->is_leaf() && !this->rope->is_slice())
+    this->flatten_rope();
 
-ObjEnumerator* ObjEnumerator::clone() const
-{
-  return new ObjEnumerator(this->type.userdef_type, this->index, this->value);
+  auto ret = new ObjString;
+
+  ret->rope = RopeNode::make_slice(this->as_rope(), begin, len);
+
+  return ret;
 }
 
-ObjFloat* ObjFloat::clone() const
+// --------------------------------------------------------
+//  InternedString
+// --------------------------------------------------------
+
+InternedString const* InternedString::get(std::u16string_view str)
 {
-  return new ObjFloat(this->value);
+  // キーは登録した文字列を指す
+  static std::unordered_map<std::u16string_view,
+                            std::unique_ptr<InternedString>>
+    table;
+
+  if (auto it = table.find(str); it != table.end())
+    return it->second.get();
+
+  auto entry = std::make_unique<InternedString>();
+
+  entry->str = metro_string_t(str);
+  entry->hash = std::hash<std::u16string_view>{}(entry->str);
+
+  auto ret = entry.get();
+
+  table.emplace(ret->str, std::move(entry));
+
+  return ret;
 }
 
-ObjChar* ObjChar::clone() const
+// --------------------------------------------------------
+//  RopeNode
+// --------------------------------------------------------
+
+void RopeNode::flatten_to(metro_string_t& out) const
 {
-  return new ObjChar(this->value);
+  std::vector<RopeNode const*> stack{this};
+
+  while (!stack.empty()) {
+    auto node = stack.back();
+    stack.pop_back();
+
+    if (node->is_leaf()) {
+      out += node->leaf;
+    }
+    else if (node->is_slice()) {
+      out.append(node->left->leaf, node->offset, node->length);
+    }
+    else {
+      stack.emplace_back(node->right.get());
+      stack.emplace_back(node->left.get());
+    }
+  }
 }
 
-ObjString* ObjString::clone() const
+std::shared_ptr<RopeNode> RopeNode::make_leaf(metro_string_t&& str)
 {
-  return new ObjString(this->characters);
+  auto node = make_heap_shared<RopeNode, TYPE_String>();
+
+  node->length = str.length();
+  node->leaf = std::move(str);
+
+  return node;
 }
 
-ObjRange* ObjRange::clone() const
+std::shared_ptr<RopeNode> RopeNode::make_concat(
+  std::shared_ptr<RopeNode> left, std::shared_ptr<RopeNode> right)
 {
-  return new ObjRange(this->begin, this->end);
+  auto node = make_heap_shared<RopeNode, TYPE_String>();
+
+  node->length = left->length + right->length;
+  node->left = std::move(left);
+  node->right = std::move(right);
+
+  return node;
 }
 
-ObjDict* ObjDict::clone() const
+std::shared_ptr<RopeNode> RopeNode::make_slice(
+  std::shared_ptr<RopeNode> const& base, size_t offset, size_t length)
 {
-  auto ret = new ObjDict;
+  auto node = make_heap_shared<RopeNode, TYPE_String>();
 
-  ret->type = this->type;
+  node->length = length;
 
-  for (auto&& item : this->items) {
-    ret->append(item.key->clone(), item.value->clone());
+  // 部分文字列の部分文字列は、元の葉を直接参照する
+  if (base->is_slice()) {
+    node->left = base->left;
+    node->offset = base->offset + offset;
+  }
+  else {
+    node->left = base;
+    node->offset = offset;
   }
 
-  return ret;
+  return node;
 }
 
-ObjVector* ObjVector::clone() const
+RopeNode::~RopeNode()
 {
-  auto ret = new ObjVector;
+  std::vector<std::shared_ptr<RopeNode>> stack;
 
-  for (auto&& xx : this->elements)
-    ret->append(xx->clone());
+  if (this->left)
+    stack.emplace_back(std::move(this->left));
 
-  return ret;
-}
\ No newline at end of file
+  if (this->right)
+    stack.emplace_back(std::move(this->right));
+
+  while (!stack.empty()) {
+    auto node = std::move(stack.back());
+    stack.pop_back();
+
+    // 最後の参照であれば、子を取り出してから解放する
+    if (node.use_count() == 1) {
+      if (node->left)
+        stack.emplace_back(std::move(node->left));
+
+      if (node->right)
+        stack.emplace_back(std::move(node->right));
+    }
+  }
+}
+
+std::string ObjRange::to_string() const
+{
+  return Utils::format("%zd..%zd", this->begin, this->end);
+}
+
+std::string ObjDict::to_string() const
+{
+  std::string s = "{";
+
+  auto nss = nested;
+  nested = 1;
+
+  for (bool first = true; auto&& x : this->items) {
+    if (x.is_removed())
+      continue;
+
+    if (!first)
+      s += ", ";
+
+    s += x.key->to_string() + ": " + x.value->to_string();
+    first = false;
+  }
+
+  nested = nss;
+
+  return s + "}";
+}
+
+std::string ObjSet::to_string() const
+{
+  std::string s = "{";
+
+  auto nss = nested;
+  nested = 1;
+
+  for (bool first = true; auto&& x : this->items) {
+    if (x.is_removed())
+      continue;
+
+    if (!first)
+      s += ", ";
+
+    s += x.key->to_string();
+    first = false;
+  }
+
+  nested = nss;
+
+  return s + "}";
+}
+
+std::string ObjDeque::to_string() const
+{
+  std::string s = "[";
+
+  auto nss = nested;
+  nested = 1;
+
+  for (size_t i = 0; i < this->count; i++) {
+    if (i != 0)
+      s += ", ";
+
+    s += this->at(i)->to_string();
+  }
+
+  nested = nss;
+
+  return s + "]";
+}
+
+std::string ObjVector::to_string() const
+{
+  std::string s = "[";
+
+  auto nss = nested;
+  nested = 1;
+
+  if (this->is_scalar) {
+    auto kind = this->layout->fields[0].kind;
+
+    for (size_t i = 0; i < this->row_count; i++) {
+      s += Object::raw_to_string(kind, this->column_ptr(i, 0));
+
+      if (i + 1 < this->row_count)
+        s += ", ";
+    }
+  }
+  else if (this->is_columnar()) {
+    auto pStruct = (AST::Struct*)this->type.type_params[0].userdef_type;
+
+    for (size_t i = 0; i < this->row_count; i++) {
+      s += std::string(pStruct->name) + "{ ";
+
+      for (size_t f = 0; f < this->layout->fields.size(); f++) {
+        s += std::string(pStruct->members[f].name) + ": " +
+             Object::raw_to_string(this->layout->fields[f].kind,
+                                   this->column_ptr(i, f));
+
+        if (f + 1 < this->layout->fields.size())
+          s += ", ";
+      }
+
+      s += " }";
+
+      if (i + 1 < this->row_count)
+        s += ", ";
+    }
+  }
+  else {
+    for (auto&& x : this->elements) {
+      s += x->to_string();
+      if (&x != &*this->elements.rbegin())
+        s += ", ";
+    }
+  }
+
+  nested = nss;
+
+  return s + "]";
+}
+
+ObjUserType* ObjUserType::clone() const
+{
+  auto obj = ObjUserType::create(this->type.userdef_type);
+
+  if (!this->layout)
+    return obj;
+
+  memcpy(obj->data(), this->data(), this->layout->size);
+
+  for (size_t i = 0; i < this->member_count(); i++) {
+    if (!this->is_inline(i)) {
+      obj->ref_member(i) = nullptr;
+      obj->set_member(i, (*(Object**)this->field_ptr(i))->clone());
+    }
+  }
+
+  return obj;
+}
+
+ObjNone* ObjNone::clone() const
+{
+  return new ObjNone;  // ???
+}
+
+ObjLong* ObjLong::clone() const
+{
+  return new ObjLong(this->value);
+}
+
+ObjUSize* ObjUSize::clone() const
+{
+  return new ObjUSize(this->value);
+}
+
+ObjEnumerator* ObjEnumerator::clone() const
+{
+  return new ObjEnumerator(this->type.userdef_type, this->index, this->value);
+}
+
+ObjFloat* ObjFloat::clone() const
+{
+  return new ObjFloat(this->value);
+}
+
+ObjChar* ObjChar::clone() const
+{
+  return new ObjChar(this->value);
+}
+
+ObjString* ObjString::clone() const
+{
+  ObjString* ret;
+
+  if (this->length() < RopeThreshold) {
+    ret = new ObjString(metro_string_t(this->view()));
+  }
+  else {
+    ret = new ObjString;
+    ret->rope = this->as_rope();
+  }
+
+  ret->interned = this->interned;
+
+  return ret;
+}
+
+ObjStringBuilder* ObjStringBuilder::clone() const
+{
+  auto ret = new ObjStringBuilder;
+
+  ret->buffer = this->buffer;
+
+  return ret;
+}
+
+ObjRange* ObjRange::clone() const
+{
+  return new ObjRange(this->begin, this->end);
+}
+
+ObjDict* ObjDict::clone() const
+{
+  auto ret = new ObjDict;
+
+  ret->type = this->type;
+  ret->rehash(this->count);
+
+  for (auto&& item : this->items) {
+    if (!item.is_removed())
+      ret->append(item.key->clone(), item.value->clone());
+  }
+
+  return ret;
+}
+
+// --------------------------------------------------------
+//  ObjDict
+// --------------------------------------------------------
+
+//
+// ObjDict と ObjSet で共通のハッシュ表の操作
+//
+// slots の値は 0 = 空き, 1 = 削除済み, それ以外 = items の添字 + 2
+// Item は key, hash, is_removed() を持つ
+static constexpr uint32_t HashSlotEmpty = 0;
+static constexpr uint32_t HashSlotRemoved = 1;
+
+//
+// キーが見つかった slots の位置、または追加する位置
+template <class Slots, class Items>
+static size_t find_hash_slot(Slots const& slots, Items const& items,
+                             Object* key, size_t hash, bool& found)
+{
+  auto mask = slots.size() - 1;
+  auto i = mix_hash(hash) & mask;
+
+  size_t insert_pos = (size_t)-1;
+
+  for (;; i = (i + 1) & mask) {
+    auto slot = slots[i];
+
+    if (slot == HashSlotEmpty) {
+      found = false;
+      return insert_pos != (size_t)-1 ? insert_pos : i;
+    }
+
+    if (slot == HashSlotRemoved) {
+      if (insert_pos == (size_t)-1)
+        insert_pos = i;
+
+      continue;
+    }
+
+    auto const& item = items[slot - 2];
+
+    if (item.hash == hash && item.key->equals(key)) {
+      found = true;
+      return i;
+    }
+  }
+}
+
+//
+// 削除した要素を詰めて、slots を作り直す
+template <class Slots, class Items>
+static void rehash_slots(Slots& slots, Items& items, size_t count,
+                         size_t capacity)
+{
+  if (count != items.size()) {
+    std::erase_if(items, [](auto const& item) {
+      return item.is_removed();
+    });
+  }
+
+  size_t size = 8;
+
+  while (size < capacity * 2)
+    size <<= 1;
+
+  slots.assign(size, HashSlotEmpty);
+
+  auto mask = size - 1;
+
+  for (uint32_t index = 0; auto&& item : items) {
+    auto i = mix_hash(item.hash) & mask;
+
+    while (slots[i] != HashSlotEmpty)
+      i = (i + 1) & mask;
+
+    slots[i] = index++ + 2;
+  }
+}
+
+size_t ObjDict::find_slot(Object* key, size_t hash, bool& found) const
+{
+  return find_hash_slot(this->slots, this->items, key, hash, found);
+}
+
+void ObjDict::rehash(size_t capacity)
+{
+  if (this->is_dense) {
+    this->rebuild_dense();
+    return;
+  }
+
+  rehash_slots(this->slots, this->items, this->count, capacity);
+}
+
+bool ObjDict::fits_dense(Object* key) const
+{
+  if (key->type.kind != TYPE_Int)
+    return false;
+
+  auto k = ((ObjLong*)key)->value;
+
+  return k >= 0 &&
+         (size_t)k < std::max(DenseMinSize, (this->count + 1) * DenseMaxRatio);
+}
+
+void ObjDict::leave_dense()
+{
+  this->is_dense = false;
+  this->dense = {};
+
+  this->rehash(this->count + 1);
+}
+
+void ObjDict::rebuild_dense()
+{
+  if (this->count != this->items.size()) {
+    std::erase_if(this->items,
+                  [](Item const& item) { return item.is_removed(); });
+  }
+
+  size_t size = 0;
+
+  for (auto&& item : this->items)
+    size = std::max(size, (size_t)((ObjLong*)item.key)->value + 1);
+
+  this->dense.assign(std::bit_ceil(size), 0);
+
+  for (uint32_t index = 0; auto&& item : this->items)
+    this->dense[((ObjLong*)item.key)->value] = ++index;
+}
+
+ObjDict::Item* ObjDict::find(Object* key)
+{
+  if (this->count == 0)
+    return nullptr;
+
+  if (this->is_dense) {
+    auto k = ((ObjLong*)key)->value;
+
+    if (k < 0 || (size_t)k >= this->dense.size() || !this->dense[k])
+      return nullptr;
+
+    return &this->items[this->dense[k] - 1];
+  }
+
+  bool found;
+  auto slot = this->find_slot(key, key->hash(), found);
+
+  return found ? &this->items[this->slots[slot] - 2] : nullptr;
+}
+
+ObjDict::Item& ObjDict::append(Object* key, Object* value)
+{
+  if (this->is_dense && !this->fits_dense(key))
+    this->leave_dense();
+
+  if (this->is_dense) {
+    auto k = ((ObjLong*)key)->value;
+
+    if ((size_t)k >= this->dense.size())
+      this->dense.resize(std::bit_ceil((size_t)k + 1));
+
+    if (auto index = this->dense[k]; index) {
+      auto& item = this->items[index - 1];
+
+      value->ref_count++;
+      item.value->ref_count--;
+      item.value = value;
+
+      return item;
+    }
+
+    this->dense[k] = this->items.size() + 1;
+    this->count++;
+
+    return this->items.emplace_back(key, value, key->hash());
+  }
+
+  // 削除済みのものも slots を使っているので、含めて数える
+  if ((this->items.size() + 1) * 2 > this->slots.size())
+    this->rehash(this->count + 1);
+
+  auto hash = key->hash();
+  bool found;
+  auto slot = this->find_slot(key, hash, found);
+
+  if (found) {
+    auto& item = this->items[this->slots[slot] - 2];
+
+    value->ref_count++;
+    item.value->ref_count--;
+    item.value = value;
+
+    return item;
+  }
+
+  this->slots[slot] = this->items.size() + 2;
+  this->count++;
+
+  return this->items.emplace_back(key, value, hash);
+}
+
+bool ObjDict::remove(Object* key)
+{
+  if (this->count == 0)
+    return false;
+
+  if (this->is_dense) {
+    auto item = this->find(key);
+
+    if (!item)
+      return false;
+
+    this->dense[((ObjLong*)key)->value] = 0;
+    item->release();
+    this->count--;
+
+    if (this->items.size() > 16 && this->count < this->items.size() / 2)
+      this->rebuild_dense();
+
+    return true;
+  }
+
+  bool found;
+  auto slot = this->find_slot(key, key->hash(), found);
+
+  if (!found)
+    return false;
+
+  this->items[this->slots[slot] - 2].release();
+  this->slots[slot] = SlotRemoved;
+  this->count--;
+
+  // 削除したものが多くなったら詰める
+  if (this->items.size() > 16 && this->count < this->items.size() / 2)
+    this->rehash(this->count);
+
+  return true;
+}
+
+void ObjDict::reserve(size_t n)
+{
+  this->items.reserve(n);
+
+  if (!this->is_dense && n * 2 > this->slots.size())
+    this->rehash(std::max(n, this->count));
+}
+
+void ObjDict::extend(ObjDict const* x)
+{
+  this->reserve(this->count + x->count);
+
+  for (auto&& item : x->items) {
+    if (!item.is_removed())
+      this->append(item.key, item.value);
+  }
+}
+
+void ObjDict::shrink_to_fit()
+{
+  this->rehash(this->count);
+  this->items.shrink_to_fit();
+  this->dense.shrink_to_fit();
+}
+
+bool ObjDict::equals(ObjDict* x) const
+{
+  if (this->count != x->count)
+    return false;
+
+  for (auto&& item : this->items) {
+    if (item.is_removed())
+      continue;
+
+    auto found = x->find(item.key);
+
+    if (!found || !item.value->equals(found->value))
+      return false;
+  }
+
+  return true;
+}
+
+// --------------------------------------------------------
+//  ObjSet
+// --------------------------------------------------------
+
+bool ObjSet::contains(Object* key) const
+{
+  if (this->count == 0)
+    return false;
+
+  bool found;
+  find_hash_slot(this->slots, this->items, key, key->hash(), found);
+
+  return found;
+}
+
+bool ObjSet::insert(Object* key)
+{
+  if ((this->items.size() + 1) * 2 > this->slots.size())
+    rehash_slots(this->slots, this->items, this->count, this->count + 1);
+
+  auto hash = key->hash();
+  bool found;
+  auto slot = find_hash_slot(this->slots, this->items, key, hash, found);
+
+  if (found)
+    return false;
+
+  this->slots[slot] = this->items.size() + 2;
+  this->items.emplace_back(key, hash);
+  this->count++;
+
+  return true;
+}
+
+bool ObjSet::remove(Object* key)
+{
+  if (this->count == 0)
+    return false;
+
+  bool found;
+  auto slot =
+    find_hash_slot(this->slots, this->items, key, key->hash(), found);
+
+  if (!found)
+    return false;
+
+  this->items[this->slots[slot] - 2].release();
+  this->slots[slot] = SlotRemoved;
+  this->count--;
+
+  if (this->items.size() > 16 && this->count < this->items.size() / 2)
+    rehash_slots(this->slots, this->items, this->count, this->count);
+
+  return true;
+}
+
+bool ObjSet::equals(ObjSet* x) const
+{
+  if (this->count != x->count)
+    return false;
+
+  for (auto&& item : this->items) {
+    if (!item.is_removed() && !x->contains(item.key))
+      return false;
+  }
+
+  return true;
+}
+
+ObjSet* ObjSet::clone() const
+{
+  auto ret = new ObjSet(this->type);
+
+  rehash_slots(ret->slots, ret->items, 0, this->count);
+
+  for (auto&& item : this->items) {
+    if (!item.is_removed())
+      ret->insert(item.key->clone());
+  }
+
+  return ret;
+}
+
+// --------------------------------------------------------
+//  ObjDeque
+// --------------------------------------------------------
+
+void ObjDeque::grow()
+{
+  if (this->count < this->buffer.size())
+    return;
+
+  decltype(this->buffer) buf(std::max<size_t>(this->buffer.size() * 2, 8));
+
+  for (size_t i = 0; i < this->count; i++)
+    buf[i] = this->at(i);
+
+  this->buffer = std::move(buf);
+  this->head = 0;
+}
+
+void ObjDeque::push_back(Object* obj)
+{
+  this->grow();
+
+  obj->ref_count++;
+  this->at(this->count++) = obj;
+}
+
+void ObjDeque::push_front(Object* obj)
+{
+  this->grow();
+
+  obj->ref_count++;
+  this->head = (this->head - 1) & (this->buffer.size() - 1);
+  this->count++;
+  this->at(0) = obj;
+}
+
+Object* ObjDeque::pop_back()
+{
+  auto obj = this->at(--this->count);
+
+  obj->ref_count--;
+
+  return obj;
+}
+
+Object* ObjDeque::pop_front()
+{
+  auto obj = this->at(0);
+
+  this->head = (this->head + 1) & (this->buffer.size() - 1);
+  this->count--;
+  obj->ref_count--;
+
+  return obj;
+}
+
+bool ObjDeque::equals(ObjDeque* x) const
+{
+  if (this->count != x->count)
+    return false;
+
+  for (size_t i = 0; i < this->count; i++) {
+    if (!this->at(i)->equals(x->at(i)))
+      return false;
+  }
+
+  return true;
+}
+
+ObjDeque* ObjDeque::clone() const
+{
+  auto ret = new ObjDeque(this->type);
+
+  for (size_t i = 0; i < this->count; i++)
+    ret->push_back(this->at(i)->clone());
+
+  return ret;
+}
+
+// --------------------------------------------------------
+//  ObjHeap
+// --------------------------------------------------------
+
+//
+// std::push_heap などは最大ヒープを作るので、逆の順序で比べる
+template <class T>
+static bool heap_order(T a, T b)
+{
+  return less_raw(b, a);
+}
+
+static bool heap_order_object(Object* a, Object* b)
+{
+  return b->compare(a) < 0;
+}
+
+//
+// 小さい順に並べた値・要素
+template <class T>
+static std::vector<T> sorted_values(decltype(ObjHeap::values) const& values)
+{
+  auto p = (T const*)values.data();
+  std::vector<T> ret(p, p + values.size() / sizeof(T));
+
+  std::sort(ret.begin(), ret.end(), less_raw<T>);
+
+  return ret;
+}
+
+static std::vector<Object*> sorted_objects(
+  decltype(ObjHeap::elements) const& elems)
+{
+  std::vector<Object*> ret(elems.begin(), elems.end());
+
+  std::sort(ret.begin(), ret.end(),
+            [](Object* a, Object* b) { return a->compare(b) < 0; });
+
+  return ret;
+}
+
+ObjHeap::ObjHeap(TypeInfo const& type)
+  : Object(type),
+    is_scalar(false),
+    elem_kind(TYPE_None),
+    elem_size(0)
+{
+  if (type.type_params.empty())
+    return;
+
+  this->elem_kind = type.type_params[0].kind;
+  this->elem_size = StructLayout::get_inline_size(this->elem_kind);
+  this->is_scalar = this->elem_size != 0;
+}
+
+void ObjHeap::push(Object* obj)
+{
+  if (!this->is_scalar) {
+    obj->ref_count++;
+    this->elements.emplace_back(obj);
+
+    std::push_heap(this->elements.begin(), this->elements.end(),
+                   heap_order_object);
+
+    return;
+  }
+
+  with_scalar_type(this->elem_kind, [&]<class T>() {
+    auto n = this->size();
+
+    this->values.resize((n + 1) * sizeof(T));
+
+    auto p = (T*)this->values.data();
+
+    Object::to_raw(this->elem_kind, p + n, obj);
+    std::push_heap(p, p + n + 1, heap_order<T>);
+  });
+}
+
+Object* ObjHeap::pop()
+{
+  if (!this->is_scalar) {
+    std::pop_heap(this->elements.begin(), this->elements.end(),
+                  heap_order_object);
+
+    auto obj = this->elements.back();
+
+    this->elements.pop_back();
+    obj->ref_count--;
+
+    return obj;
+  }
+
+  Object* ret{};
+
+  with_scalar_type(this->elem_kind, [&]<class T>() {
+    auto n = this->size();
+    auto p = (T*)this->values.data();
+
+    std::pop_heap(p, p + n, heap_order<T>);
+
+    ret = Object::from_raw(this->elem_kind, p + n - 1);
+    this->values.resize((n - 1) * sizeof(T));
+  });
+
+  return ret;
+}
+
+Object* ObjHeap::peek() const
+{
+  if (this->is_scalar)
+    return Object::from_raw(this->elem_kind, this->values.data());
+
+  return this->elements[0]->clone();
+}
+
+void ObjHeap::heapify(ObjVector const* vec)
+{
+  if (this->is_scalar) {
+    if (vec->is_scalar) {
+      auto col = vec->column_view(0);
+
+      this->values.insert(this->values.end(), col.begin(), col.end());
+    }
+    else {
+      auto n = this->values.size();
+
+      this->values.resize(n + vec->size() * this->elem_size);
+
+      for (size_t i = 0; i < vec->size(); i++)
+        Object::to_raw(this->elem_kind,
+                       this->values.data() + n + i * this->elem_size,
+                       vec->get_element(i));
+    }
+
+    with_scalar_type(this->elem_kind, [&]<class T>() {
+      auto p = (T*)this->values.data();
+
+      std::make_heap(p, p + this->size(), heap_order<T>);
+    });
+
+    return;
+  }
+
+  this->elements.reserve(this->elements.size() + vec->size());
+
+  for (size_t i = 0; i < vec->size(); i++)
+    this->elements.emplace_back(vec->get_element(i)->clone())->ref_count++;
+
+  std::make_heap(this->elements.begin(), this->elements.end(),
+                 heap_order_object);
+}
+
+bool ObjHeap::equals(ObjHeap* x) const
+{
+  if (this->size() != x->size())
+    return false;
+
+  if (this->is_scalar) {
+    bool ret = false;
+
+    with_scalar_type(this->elem_kind, [&]<class T>() {
+      ret = sorted_values<T>(this->values) == sorted_values<T>(x->values);
+    });
+
+    return ret;
+  }
+
+  auto a = sorted_objects(this->elements);
+  auto b = sorted_objects(x->elements);
+
+  for (size_t i = 0; i < a.size(); i++) {
+    if (!a[i]->equals(b[i]))
+      return false;
+  }
+
+  return true;
+}
+
+std::string ObjHeap::to_string() const
+{
+  std::string s = "[";
+
+  auto nss = nested;
+  nested = 1;
+
+  if (this->is_scalar) {
+    with_scalar_type(this->elem_kind, [&]<class T>() {
+      for (bool first = true; T value : sorted_values<T>(this->values)) {
+        if (!first)
+          s += ", ";
+
+        s += Object::raw_to_string(this->elem_kind, &value);
+        first = false;
+      }
+    });
+  }
+  else {
+    auto sorted = sorted_objects(this->elements);
+
+    for (size_t i = 0; i < sorted.size(); i++) {
+      if (i != 0)
+        s += ", ";
+
+      s += sorted[i]->to_string();
+    }
+  }
+
+  nested = nss;
+
+  return s + "]";
+}
+
+ObjHeap* ObjHeap::clone() const
+{
+  auto ret = new ObjHeap(this->type);
+
+  ret->values = this->values;
+  ret->elements.reserve(this->elements.size());
+
+  // 同じ値なので、並びはそのままでよい
+  for (auto&& elem : this->elements)
+    ret->elements.emplace_back(elem->clone())->ref_count++;
+
+  return ret;
+}
+
+// --------------------------------------------------------
+//  ObjBitset
+// --------------------------------------------------------
+
+//
+// 立っているビットの位置を並べる
+std::string ObjBitset::to_string() const
+{
+  std::string s = "{";
+
+  for (auto i = this->find_next(0); i < this->length;
+       i = this->find_next(i + 1)) {
+    if (s.length() > 1)
+      s += ", ";
+
+    s += std::to_string(i);
+  }
+
+  return s + "}";
+}
+
+ObjBitset* ObjBitset::clone() const
+{
+  auto ret = new ObjBitset;
+
+  ret->words = this->words;
+  ret->length = this->length;
+
+  return ret;
+}
+
+size_t ObjBitset::count() const
+{
+  return Kernel::popcount(this->words.data(), this->words.size());
+}
+
+size_t ObjBitset::find_next(size_t index) const
+{
+  if (index >= this->length)
+    return this->length;
+
+  auto w = index / 64;
+
+  // index より前のビットを落とす
+  auto bits = this->words[w] & (~(uint64_t)0 << (index % 64));
+
+  while (!bits) {
+    if (++w == this->words.size())
+      return this->length;
+
+    bits = this->words[w];
+  }
+
+  return w * 64 + std::countr_zero(bits);
+}
+
+void ObjBitset::resize(size_t n)
+{
+  this->words.resize((n + 63) / 64);
+  this->length = n;
+
+  // 最後の語の、n より後ろのビットを 0 にする
+  if (n % 64)
+    this->words.back() &= ((uint64_t)1 << (n % 64)) - 1;
+}
+
+void ObjBitset::bit_and(ObjBitset const* x)
+{
+  auto n = std::min(this->words.size(), x->words.size());
+
+  Kernel::bit_and(this->words.data(), x->words.data(), n);
+
+  // x にない部分は 0
+  std::fill(this->words.begin() + n, this->words.end(), 0);
+
+  if (x->length > this->length)
+    this->resize(x->length);
+}
+
+void ObjBitset::bit_or(ObjBitset const* x)
+{
+  if (x->length > this->length)
+    this->resize(x->length);
+
+  Kernel::bit_or(this->words.data(), x->words.data(), x->words.size());
+}
+
+void ObjBitset::bit_xor(ObjBitset const* x)
+{
+  if (x->length > this->length)
+    this->resize(x->length);
+
+  Kernel::bit_xor(this->words.data(), x->words.data(), x->words.size());
+}
+
+void ObjBitset::flip()
+{
+  Kernel::bit_not(this->words.data(), this->words.size());
+
+  this->resize(this->length);
+}
+
+// --------------------------------------------------------
+//  ObjNdArray
+// --------------------------------------------------------
+
+std::vector<size_t> ObjNdArray::row_major_strides(
+  std::vector<size_t> const& shape)
+{
+  std::vector<size_t> ret(shape.size());
+  size_t stride = 1;
+
+  for (size_t i = shape.size(); i-- > 0;) {
+    ret[i] = stride;
+    stride *= shape[i];
+  }
+
+  return ret;
+}
+
+ObjNdArray* ObjNdArray::create(TypeKind kind, std::vector<size_t> const& shape)
+{
+  auto ret = new ObjNdArray(TypeInfo(TYPE_NdArray, {kind}));
+
+  ret->shape = shape;
+  ret->strides = row_major_strides(shape);
+  ret->buffer->resize(ret->size() * ret->elem_size());
+
+  return ret;
+}
+
+size_t ObjNdArray::size() const
+{
+  size_t n = 1;
+
+  for (auto&& x : this->shape)
+    n *= x;
+
+  return n;
+}
+
+bool ObjNdArray::is_contiguous() const
+{
+  return this->strides == row_major_strides(this->shape);
+}
+
+size_t ObjNdArray::position(size_t linear) const
+{
+  auto pos = this->offset;
+
+  for (size_t i = this->shape.size(); i-- > 0;) {
+    pos += linear % this->shape[i] * this->strides[i];
+    linear /= this->shape[i];
+  }
+
+  return pos;
+}
+
+Object* ObjNdArray::get_element(size_t linear) const
+{
+  return Object::from_raw(this->elem_kind(), this->buffer->data() +
+                                               this->position(linear) *
+                                                 this->elem_size());
+}
+
+void ObjNdArray::set_element(size_t linear, Object* obj)
+{
+  this->make_unique();
+
+  Object::to_raw(this->elem_kind(),
+                 this->buffer->data() + linear * this->elem_size(), obj);
+}
+
+//
+// 要素を行優先の順に並べた、新しい領域
+static std::shared_ptr<ObjNdArray::Buffer> copy_elements(
+  ObjNdArray const* arr)
+{
+  auto size = StructLayout::get_inline_size(arr->elem_kind());
+  auto n = arr->size();
+  auto src = arr->buffer->data();
+  auto ret = make_heap_shared<ObjNdArray::Buffer, TYPE_NdArray>(n * size);
+
+  if (arr->is_contiguous()) {
+    std::memcpy(ret->data(), src + arr->offset * size, n * size);
+    return ret;
+  }
+
+  for (size_t i = 0; i < n; i++)
+    std::memcpy(ret->data() + i * size, src + arr->position(i) * size, size);
+
+  return ret;
+}
+
+void ObjNdArray::make_contiguous()
+{
+  if (this->is_contiguous())
+    return;
+
+  this->buffer = copy_elements(this);
+  this->offset = 0;
+  this->strides = row_major_strides(this->shape);
+}
+
+void ObjNdArray::make_unique()
+{
+  if (this->buffer.use_count() == 1 && this->offset == 0 &&
+      this->is_contiguous())
+    return;
+
+  this->buffer = copy_elements(this);
+  this->offset = 0;
+  this->strides = row_major_strides(this->shape);
+}
+
+ObjNdArray* ObjNdArray::transpose() const
+{
+  auto ret = this->clone();
+
+  std::reverse(ret->shape.begin(), ret->shape.end());
+  std::reverse(ret->strides.begin(), ret->strides.end());
+
+  return ret;
+}
+
+ObjNdArray* ObjNdArray::reshape(std::vector<size_t> const& new_shape) const
+{
+  auto ret = this->clone();
+
+  ret->make_contiguous();
+  ret->shape = new_shape;
+  ret->strides = row_major_strides(new_shape);
+
+  return ret;
+}
+
+void ObjNdArray::combine(AST::ExprKind kind, Object const* x)
+{
+  with_scalar_type(this->elem_kind(), [&]<class T>() {
+    if constexpr (std::is_same_v<T, int64_t> || std::is_same_v<T, float>) {
+      auto n = this->size();
+      auto p = this->mutable_data<T>();
+
+      //
+      // 要素の型の値
+      if (x->type.kind != TYPE_NdArray) {
+        T v;
+
+        Object::to_raw(this->elem_kind(), &v, x);
+
+        switch (kind) {
+          case AST::EX_Add:
+            for (size_t i = 0; i < n; i++)
+              p[i] += v;
+            break;
+
+          case AST::EX_Sub:
+            for (size_t i = 0; i < n; i++)
+              p[i] -= v;
+            break;
+
+          case AST::EX_Mul:
+            Kernel::scale(p, n, v);
+            break;
+
+          case AST::EX_Div:
+            for (size_t i = 0; i < n; i++)
+              p[i] /= v;
+            break;
+        }
+
+        return;
+      }
+
+      //
+      // 同じ形の n 次元配列
+      auto arr = (ObjNdArray const*)x;
+      auto elems = arr->is_contiguous() ? nullptr : copy_elements(arr);
+      auto q = elems ? (T const*)elems->data() : arr->data<T>();
+
+      switch (kind) {
+        case AST::EX_Add:
+          Kernel::add(p, q, n);
+          break;
+
+        case AST::EX_Sub:
+          Kernel::sub(p, q, n);
+          break;
+
+        case AST::EX_Mul:
+          Kernel::mul(p, q, n);
+          break;
+
+        case AST::EX_Div:
+          for (size_t i = 0; i < n; i++)
+            p[i] /= q[i];
+          break;
+      }
+    }
+  });
+}
+
+//
+// axis 番目の軸より後ろを、pos の位置から書き出す
+static void ndarray_to_string(ObjNdArray const* arr, size_t axis, size_t pos,
+                              std::string& s)
+{
+  auto kind = arr->elem_kind();
+  auto size = StructLayout::get_inline_size(kind);
+
+  if (axis == arr->ndim()) {
+    s += Object::raw_to_string(kind, arr->buffer->data() + pos * size);
+    return;
+  }
+
+  s += "[";
+
+  for (size_t i = 0; i < arr->shape[axis]; i++) {
+    if (i != 0)
+      s += ", ";
+
+    ndarray_to_string(arr, axis + 1, pos + i * arr->strides[axis], s);
+  }
+
+  s += "]";
+}
+
+std::string ObjNdArray::to_string() const
+{
+  std::string s;
+
+  ndarray_to_string(this, 0, this->offset, s);
+
+  return s;
+}
+
+ObjNdArray* ObjNdArray::clone() const
+{
+  auto ret = new ObjNdArray(this->type);
+
+  ret->buffer = this->buffer;
+  ret->offset = this->offset;
+  ret->shape = this->shape;
+  ret->strides = this->strides;
+
+  return ret;
+}
+
+bool ObjNdArray::equals(ObjNdArray* x) const
+{
+  if (this->shape != x->shape)
+    return false;
+
+  bool ret = true;
+
+  with_scalar_type(this->elem_kind(), [&]<class T>() {
+    auto p = (T const*)this->buffer->data();
+    auto q = (T const*)x->buffer->data();
+
+    for (size_t i = 0; ret && i < this->size(); i++)
+      ret = p[this->position(i)] == q[x->position(i)];
+  });
+
+  return ret;
+}
+
+// --------------------------------------------------------
+//  PVecNode
+// --------------------------------------------------------
+
+PVecNode::PVecNode(PVecNode const& node)
+{
+  for (size_t i = 0; i < Width; i++) {
+    this->children[i] = node.children[i];
+
+    if ((this->values[i] = node.values[i]))
+      this->values[i]->ref_count++;
+  }
+}
+
+PVecNode::~PVecNode()
+{
+  for (auto&& v : this->values)
+    if (v)
+      v->ref_count--;
+}
+
+//
+// 自分だけが持っている節にする (なければ作る)
+// 親から順に呼ぶこと (親をコピーすると、子の use_count が増えるので)
+static PVecNode* make_unique_node(std::shared_ptr<PVecNode>& node)
+{
+  if (!node)
+    node = make_heap_shared<PVecNode, TYPE_PVector>();
+  else if (node.use_count() != 1)
+    node = make_heap_shared<PVecNode, TYPE_PVector>(*node);
+
+  return node.get();
+}
+
+//
+// leaf だけを持つ、深さ level / Bits の経路
+static std::shared_ptr<PVecNode> new_path(size_t level,
+                                          std::shared_ptr<PVecNode> leaf)
+{
+  if (level == 0)
+    return leaf;
+
+  auto node = make_heap_shared<PVecNode, TYPE_PVector>();
+  node->children[0] = new_path(level - PVecNode::Bits, std::move(leaf));
+
+  return node;
+}
+
+// --------------------------------------------------------
+//  ObjPVector
+// --------------------------------------------------------
+
+ObjPVector::ObjPVector(TypeInfo const& type)
+  : Object(type),
+    root(make_heap_shared<PVecNode, TYPE_PVector>()),
+    tail(make_heap_shared<PVecNode, TYPE_PVector>()),
+    count(0),
+    shift(PVecNode::Bits)
+{
+}
+
+Object* ObjPVector::get(size_t index) const
+{
+  if (index >= this->tail_offset())
+    return this->tail->values[index & PVecNode::Mask];
+
+  auto node = this->root.get();
+
+  for (auto level = this->shift; level > 0; level -= PVecNode::Bits)
+    node = node->children[(index >> level) & PVecNode::Mask].get();
+
+  return node->values[index & PVecNode::Mask];
+}
+
+void ObjPVector::set(size_t index, Object* obj)
+{
+  PVecNode* leaf;
+
+  if (index >= this->tail_offset()) {
+    leaf = make_unique_node(this->tail);
+  }
+  else {
+    auto ref = &this->root;
+
+    for (auto level = this->shift; level > 0; level -= PVecNode::Bits)
+      ref = &make_unique_node(*ref)
+               ->children[(index >> level) & PVecNode::Mask];
+
+    leaf = make_unique_node(*ref);
+  }
+
+  auto& slot = leaf->values[index & PVecNode::Mask];
+
+  obj->ref_count++;
+  slot->ref_count--;
+  slot = obj;
+}
+
+//
+// 満杯になった tail を木に入れる
+// count は tail の要素を含めた数 (まだ新しい要素を数えていない)
+static void push_tail(std::shared_ptr<PVecNode>& ref, size_t level,
+                      size_t count, std::shared_ptr<PVecNode> leaf)
+{
+  auto node = make_unique_node(ref);
+  auto& child = node->children[((count - 1) >> level) & PVecNode::Mask];
+
+  if (level == PVecNode::Bits)
+    child = std::move(leaf);
+  else if (child)
+    push_tail(child, level - PVecNode::Bits, count, std::move(leaf));
+  else
+    child = new_path(level - PVecNode::Bits, std::move(leaf));
+}
+
+void ObjPVector::push(Object* obj)
+{
+  obj->ref_count++;
+
+  if (this->count - this->tail_offset() < PVecNode::Width) {
+    make_unique_node(this->tail)
+      ->values[this->count++ - this->tail_offset()] = obj;
+
+    return;
+  }
+
+  auto full = std::move(this->tail);
+
+  // 根が満杯なら、一段深くする
+  if ((this->count >> PVecNode::Bits) > ((size_t)1 << this->shift)) {
+    auto node = make_heap_shared<PVecNode, TYPE_PVector>();
+
+    node->children[0] = std::move(this->root);
+    node->children[1] = new_path(this->shift, std::move(full));
+
+    this->root = std::move(node);
+    this->shift += PVecNode::Bits;
+  }
+  else {
+    push_tail(this->root, this->shift, this->count, std::move(full));
+  }
+
+  this->tail = make_heap_shared<PVecNode, TYPE_PVector>();
+  this->tail->values[0] = obj;
+  this->count++;
+}
+
+//
+// 最後の葉を取り除いた木 (空になれば nullptr)
+// index は取り除いた後の最後の要素の位置
+static std::shared_ptr<PVecNode> pop_tail(std::shared_ptr<PVecNode> const& node,
+                                          size_t level, size_t index)
+{
+  auto sub = (index >> level) & PVecNode::Mask;
+
+  if (level > PVecNode::Bits) {
+    auto child = pop_tail(node->children[sub], level - PVecNode::Bits, index);
+
+    if (!child && sub == 0)
+      return nullptr;
+
+    auto ret = make_heap_shared<PVecNode, TYPE_PVector>(*node);
+    ret->children[sub] = std::move(child);
+
+    return ret;
+  }
+
+  if (sub == 0)
+    return nullptr;
+
+  auto ret = make_heap_shared<PVecNode, TYPE_PVector>(*node);
+  ret->children[sub] = nullptr;
+
+  return ret;
+}
+
+Object* ObjPVector::pop()
+{
+  auto last = this->count - 1;
+  auto ret = this->get(last)->clone();
+
+  if (this->count == 1) {
+    this->root = make_heap_shared<PVecNode, TYPE_PVector>();
+    this->tail = make_heap_shared<PVecNode, TYPE_PVector>();
+    this->count = 0;
+    this->shift = PVecNode::Bits;
+
+    return ret;
+  }
+
+  // tail に残りがある
+  if (last > this->tail_offset()) {
+    auto tail = make_unique_node(this->tail);
+    auto& slot = tail->values[last - this->tail_offset()];
+
+    slot->ref_count--;
+    slot = nullptr;
+    this->count--;
+
+    return ret;
+  }
+
+  // 木の最後の葉を tail にする
+  auto ref = &this->root;
+
+  for (auto level = this->shift; level > 0; level -= PVecNode::Bits)
+    ref = &(*ref)->children[((last - 1) >> level) & PVecNode::Mask];
+
+  this->tail = *ref;
+
+  if (!(this->root = pop_tail(this->root, this->shift, last - 1)))
+    this->root = make_heap_shared<PVecNode, TYPE_PVector>();
+
+  // 根の子がひとつだけなら、一段浅くする
+  if (this->shift > PVecNode::Bits && !this->root->children[1]) {
+    this->root = this->root->children[0];
+    this->shift -= PVecNode::Bits;
+  }
+
+  this->count--;
+
+  return ret;
+}
+
+std::string ObjPVector::to_string() const
+{
+  std::string s = "[";
+
+  auto nss = nested;
+  nested = 1;
+
+  for (size_t i = 0; i < this->count; i++) {
+    if (i != 0)
+      s += ", ";
+
+    s += this->get(i)->to_string();
+  }
+
+  nested = nss;
+
+  return s + "]";
+}
+
+bool ObjPVector::equals(ObjPVector* x) const
+{
+  if (this->count != x->count)
+    return false;
+
+  // 同じ節を共有していれば、比べるまでもない
+  if (this->root == x->root && this->tail == x->tail)
+    return true;
+
+  for (size_t i = 0; i < this->count; i++) {
+    if (!this->get(i)->equals(x->get(i)))
+      return false;
+  }
+
+  return true;
+}
+
+ObjPVector* ObjPVector::clone() const
+{
+  auto ret = new ObjPVector(this->type);
+
+  ret->root = this->root;
+  ret->tail = this->tail;
+  ret->count = this->count;
+  ret->shift = this->shift;
+
+  return ret;
+}
+
+// --------------------------------------------------------
+//  HamtNode
+// --------------------------------------------------------
+
+static constexpr size_t HamtBits = 5;
+static constexpr size_t HamtHashBits = sizeof(size_t) * 8;
+
+HamtNode::HamtNode(HamtNode const& node)
+  : bitmap(node.bitmap),
+    is_collision(node.is_collision),
+    entries(node.entries)
+{
+  for (auto&& e : this->entries) {
+    if (e.key) {
+      e.key->ref_count++;
+      e.value->ref_count++;
+    }
+  }
+}
+
+HamtNode::~HamtNode()
+{
+  for (auto&& e : this->entries) {
+    if (e.key) {
+      e.key->ref_count--;
+      e.value->ref_count--;
+    }
+  }
+}
+
+static HamtNode* make_unique_node(std::shared_ptr<HamtNode>& node)
+{
+  if (!node)
+    node = make_heap_shared<HamtNode, TYPE_PDict>();
+  else if (node.use_count() != 1)
+    node = make_heap_shared<HamtNode, TYPE_PDict>(*node);
+
+  return node.get();
+}
+
+static HamtNode::Entry make_hamt_entry(size_t hash, Object* key, Object* value)
+{
+  key->ref_count++;
+  value->ref_count++;
+
+  return {hash, key, value, nullptr};
+}
+
+//
+// 追加する (すでにあるキーなら値を置き換える)
+// 新しく追加したら true
+static bool hamt_set(std::shared_ptr<HamtNode>& ref, size_t shift, size_t hash,
+                     Object* key, Object* value)
+{
+  auto node = make_unique_node(ref);
+
+  if (node->is_collision) {
+    for (auto&& e : node->entries) {
+      if (e.key->equals(key)) {
+        value->ref_count++;
+        e.value->ref_count--;
+        e.value = value;
+
+        return false;
+      }
+    }
+
+    node->entries.emplace_back(make_hamt_entry(hash, key, value));
+    return true;
+  }
+
+  auto bit = (uint32_t)1 << ((hash >> shift) & 31);
+  auto index = std::popcount(node->bitmap & (bit - 1));
+
+  if (!(node->bitmap & bit)) {
+    node->bitmap |= bit;
+    node->entries.insert(node->entries.begin() + index,
+                         make_hamt_entry(hash, key, value));
+
+    return true;
+  }
+
+  auto& e = node->entries[index];
+
+  if (e.child)
+    return hamt_set(e.child, shift + HamtBits, hash, key, value);
+
+  if (e.hash == hash && e.key->equals(key)) {
+    value->ref_count++;
+    e.value->ref_count--;
+    e.value = value;
+
+    return false;
+  }
+
+  //
+  // 別のキーとぶつかった
+  //  --> 二つを持つ子を作る
+  std::shared_ptr<HamtNode> child;
+
+  if (e.hash == hash || shift + HamtBits >= HamtHashBits) {
+    child = make_heap_shared<HamtNode, TYPE_PDict>();
+    child->is_collision = true;
+    child->entries.emplace_back(make_hamt_entry(e.hash, e.key, e.value));
+    child->entries.emplace_back(make_hamt_entry(hash, key, value));
+  }
+  else {
+    hamt_set(child, shift + HamtBits, e.hash, e.key, e.value);
+    hamt_set(child, shift + HamtBits, hash, key, value);
+  }
+
+  e.key->ref_count--;
+  e.value->ref_count--;
+  e = {0, nullptr, nullptr, std::move(child)};
+
+  return true;
+}
+
+//
+// 削除する (キーがあること)
+// 空になった節は nullptr にする
+static void hamt_remove(std::shared_ptr<HamtNode>& ref, size_t shift,
+                        size_t hash, Object* key)
+{
+  auto node = make_unique_node(ref);
+
+  if (node->is_collision) {
+    for (auto it = node->entries.begin(); it != node->entries.end(); it++) {
+      if (it->key->equals(key)) {
+        it->key->ref_count--;
+        it->value->ref_count--;
+        node->entries.erase(it);
+        break;
+      }
+    }
+  }
+  else {
+    auto bit = (uint32_t)1 << ((hash >> shift) & 31);
+    auto index = std::popcount(node->bitmap & (bit - 1));
+    auto& e = node->entries[index];
+
+    if (e.child)
+      hamt_remove(e.child, shift + HamtBits, hash, key);
+    else {
+      e.key->ref_count--;
+      e.value->ref_count--;
+    }
+
+    if (!e.child) {
+      node->bitmap &= ~bit;
+      node->entries.erase(node->entries.begin() + index);
+    }
+  }
+
+  if (node->entries.empty())
+    ref = nullptr;
+}
+
+static void hamt_collect(HamtNode const* node,
+                         std::vector<std::pair<Object*, Object*>>& out)
+{
+  for (auto&& e : node->entries) {
+    if (e.child)
+      hamt_collect(e.child.get(), out);
+    else
+      out.emplace_back(e.key, e.value);
+  }
+}
+
+// --------------------------------------------------------
+//  ObjPDict
+// --------------------------------------------------------
+
+//
+// 下位のビットだけが変わる整数のキーでも、枝が偏らないように混ぜる
+static size_t hamt_hash(Object* key)
+{
+  return mix_hash(key->hash());
+}
+
+Object* ObjPDict::find(Object* key) const
+{
+  auto hash = hamt_hash(key);
+  auto node = this->root.get();
+
+  for (size_t shift = 0; node; shift += HamtBits) {
+    if (node->is_collision) {
+      for (auto&& e : node->entries)
+        if (e.key->equals(key))
+          return e.value;
+
+      return nullptr;
+    }
+
+    auto bit = (uint32_t)1 << ((hash >> shift) & 31);
+
+    if (!(node->bitmap & bit))
+      return nullptr;
+
+    auto& e = node->entries[std::popcount(node->bitmap & (bit - 1))];
+
+    if (!e.child)
+      return e.hash == hash && e.key->equals(key) ? e.value : nullptr;
+
+    node = e.child.get();
+  }
+
+  return nullptr;
+}
+
+void ObjPDict::set(Object* key, Object* value)
+{
+  if (hamt_set(this->root, 0, hamt_hash(key), key, value))
+    this->count++;
+}
+
+bool ObjPDict::remove(Object* key)
+{
+  // 無いキーのために経路をコピーしないように、先に探す
+  if (!this->find(key))
+    return false;
+
+  hamt_remove(this->root, 0, hamt_hash(key), key);
+  this->count--;
+
+  return true;
+}
+
+std::vector<std::pair<Object*, Object*>> ObjPDict::entries() const
+{
+  std::vector<std::pair<Object*, Object*>> ret;
+
+  ret.reserve(this->count);
+
+  if (this->root)
+    hamt_collect(this->root.get(), ret);
+
+  return ret;
+}
+
+std::string ObjPDict::to_string() const
+{
+  std::string s = "{";
+
+  auto nss = nested;
+  nested = 1;
+
+  for (bool first = true; auto&& [key, value] : this->entries()) {
+    if (!first)
+      s += ", ";
+
+    s += key->to_string() + ": " + value->to_string();
+    first = false;
+  }
+
+  nested = nss;
+
+  return s + "}";
+}
+
+bool ObjPDict::equals(ObjPDict* x) const
+{
+  if (this->count != x->count)
+    return false;
+
+  if (this->root == x->root)
+    return true;
+
+  for (auto&& [key, value] : this->entries()) {
+    auto v = x->find(key);
+
+    if (!v || !value->equals(v))
+      return false;
+  }
+
+  return true;
+}
+
+ObjPDict* ObjPDict::clone() const
+{
+  auto ret = new ObjPDict(this->type);
+
+  ret->root = this->root;
+  ret->count = this->count;
+
+  return ret;
+}
+
+ObjVector* ObjVector::clone() const
+{
+  auto ret = new ObjVector(this->type);
+
+  if (this->is_columnar()) {
+    ret->columns = this->columns;
+    ret->row_offset = this->row_offset;
+    ret->row_count = this->row_count;
+  }
+  else {
+    for (auto&& xx : this->elements)
+      ret->append(xx->clone());
+  }
+
+  return ret;
+}
+
+// --------------------------------------------------------
+//  ObjVector
+// --------------------------------------------------------
+
+ObjVector::ObjVector(TypeInfo const& type)
+  : ObjVector()
+{
+  this->type = type;
+
+  if (type.type_params.empty())
+    return;
+
+  auto const& elem = type.type_params[0];
+
+  if (StructLayout::get_inline_size(elem.kind) != 0) {
+    this->layout = &StructLayout::get_scalar_layout(elem.kind);
+    this->columns = make_heap_shared<Columns, TYPE_Vector>(1);
+    this->is_scalar = true;
+  }
+  else if (elem.kind == TYPE_UserDef && elem.userdef_type &&
+      elem.userdef_type->kind == AST_Struct) {
+    auto const& layout = ((AST::Struct*)elem.userdef_type)->layout;
+
+    if (layout.is_plain()) {
+      this->layout = &layout;
+      this->columns = 
+        make_heap_shared<Columns, TYPE_Vector>(layout.fields.size());
+    }
+  }
+}
+
+bool ObjVector::equals(ObjVector* x) const
+{
+  if (this->size() != x->size())
+    return false;
+
+  if (this->is_columnar() && x->is_columnar()) {
+    for (size_t f = 0; f < this->layout->fields.size(); f++) {
+      if (this->column_view(f) != x->column_view(f))
+        return false;
+    }
+
+    return true;
+  }
+
+  for (size_t i = 0; i < this->size(); i++) {
+    if (!this->get_element(i)->equals(x->get_element(i)))
+      return false;
+  }
+
+  return true;
+}
+
+Object* ObjVector::get_element(size_t index) const
+{
+  if (!this->is_columnar())
+    return this->elements[index];
+
+  if (this->is_scalar)
+    return this->get_field(index, 0);
+
+  auto obj = ObjUserType::create(this->type.type_params[0].userdef_type);
+
+  for (size_t f = 0; f < this->layout->fields.size(); f++) {
+    memcpy(obj->field_ptr(f), this->column_ptr(index, f),
+           StructLayout::get_inline_size(this->layout->fields[f].kind));
+  }
+
+  return obj;
+}
+
+void ObjVector::set_element(size_t index, Object* obj)
+{
+  if (this->is_scalar) {
+    this->set_field(index, 0, obj);
+    return;
+  }
+
+  if (this->is_columnar()) {
+    auto src = (ObjUserType*)obj;
+
+    this->make_unique();
+
+    for (size_t f = 0; f < this->layout->fields.size(); f++) {
+      memcpy(this->column_ptr(index, f), src->field_ptr(f),
+             StructLayout::get_inline_size(this->layout->fields[f].kind));
+    }
+
+    return;
+  }
+
+  auto& ref = this->elements[index];
+
+  obj->ref_count++;
+  ref->ref_count--;
+  ref = obj;
+}
+
+Object* ObjVector::get_field(size_t index, size_t field) const
+{
+  return Object::from_raw(this->layout->fields[field].kind,
+                          this->column_ptr(index, field));
+}
+
+void ObjVector::set_field(size_t index, size_t field, Object* obj)
+{
+  this->make_unique();
+
+  Object::to_raw(this->layout->fields[field].kind,
+                 this->column_ptr(index, field), obj);
+}
+
+Object* ObjVector::append(Object* obj)
+{
+  if (this->is_columnar()) {
+    this->make_unique();
+
+    for (size_t f = 0; f < this->layout->fields.size(); f++) {
+      auto& col = (*this->columns)[f];
+
+      col.resize(col.size() +
+                 StructLayout::get_inline_size(this->layout->fields[f].kind));
+    }
+
+    this->set_element(this->row_count++, obj);
+
+    return obj;
+  }
+
+  obj->ref_count++;
+
+  return this->elements.emplace_back(obj);
+}
+
+void ObjVector::reserve(size_t n)
+{
+  if (!this->is_columnar()) {
+    this->elements.reserve(n);
+    return;
+  }
+
+  this->make_unique();
+
+  for (size_t f = 0; f < this->layout->fields.size(); f++) {
+    (*this->columns)[f].reserve(
+      n * StructLayout::get_inline_size(this->layout->fields[f].kind));
+  }
+}
+
+void ObjVector::extend(ObjVector const* x)
+{
+  auto count = x->size();
+
+  // 格納方法が違う
+  //  --> 一つずつ追加する
+  if (this->layout != x->layout) {
+    this->reserve(this->size() + count);
+
+    for (size_t i = 0; i < count; i++)
+      this->append(x->get_element(i));
+
+    return;
+  }
+
+  if (this->is_columnar()) {
+    // x が自分自身の場合もあるので、先に範囲を取っておく
+    std::vector<std::string_view> views;
+
+    auto keep = x->columns;
+
+    for (size_t f = 0; f < this->layout->fields.size(); f++)
+      views.emplace_back(x->column_view(f));
+
+    this->make_unique();
+
+    for (size_t f = 0; f < this->layout->fields.size(); f++) {
+      auto& col = (*this->columns)[f];
+
+      col.insert(col.end(), views[f].begin(), views[f].end());
+    }
+
+    this->row_count += count;
+    return;
+  }
+
+  // 自分自身を追加する場合は、コピー元が再確保で無効にならないようにする
+  if (x == this) {
+    this->elements.reserve(count * 2);
+    std::copy_n(this->elements.begin(), count,
+                std::back_inserter(this->elements));
+  }
+  else {
+    this->elements.insert(this->elements.end(), x->elements.begin(),
+                          x->elements.end());
+  }
+
+  for (auto it = this->elements.end() - count; it != this->elements.end(); it++)
+    (*it)->ref_count++;
+}
+
+void ObjVector::resize(size_t n, Object* value)
+{
+  auto size = this->size();
+
+  if (n <= size) {
+    this->truncate(n);
+    return;
+  }
+
+  if (!this->is_columnar()) {
+    this->elements.reserve(n);
+
+    for (size_t i = size; i < n; i++)
+      this->append(value->clone());
+
+    return;
+  }
+
+  this->make_unique();
+
+  for (size_t f = 0; f < this->layout->fields.size(); f++) {
+    (*this->columns)[f].resize(
+      n * StructLayout::get_inline_size(this->layout->fields[f].kind));
+  }
+
+  this->row_count = n;
+
+  // 一つ目だけ書き込み、残りはバイト列をコピーする
+  this->set_element(size, value);
+
+  for (size_t f = 0; f < this->layout->fields.size(); f++) {
+    auto width = StructLayout::get_inline_size(this->layout->fields[f].kind);
+    auto src = this->column_ptr(size, f);
+
+    for (size_t i = size + 1; i < n; i++)
+      memcpy(this->column_ptr(i, f), src, width);
+  }
+}
+
+void ObjVector::truncate(size_t n)
+{
+  if (n >= this->size())
+    return;
+
+  if (!this->is_columnar()) {
+    for (size_t i = n; i < this->elements.size(); i++)
+      this->elements[i]->ref_count--;
+
+    this->elements.resize(n);
+    return;
+  }
+
+  // 共有している列は、範囲を狭めるだけ
+  if (this->columns.use_count() > 1) {
+    this->row_count = n;
+    return;
+  }
+
+  this->make_unique();
+
+  for (size_t f = 0; f < this->layout->fields.size(); f++) {
+    (*this->columns)[f].resize(
+      n * StructLayout::get_inline_size(this->layout->fields[f].kind));
+  }
+
+  this->row_count = n;
+}
+
+void ObjVector::shrink_to_fit()
+{
+  if (!this->is_columnar()) {
+    this->elements.shrink_to_fit();
+    return;
+  }
+
+  this->make_unique();
+
+  for (auto&& col : *this->columns)
+    col.shrink_to_fit();
+}
+
+ObjVector* ObjVector::slice(size_t begin, size_t end) const
+{
+  auto ret = new ObjVector(this->type);
+
+  if (this->is_columnar()) {
+    ret->columns = this->columns;
+    ret->row_offset = this->row_offset + begin;
+    ret->row_count = end - begin;
+  }
+  else {
+    // 要素はオブジェクトなので、共有せずに複製する
+    for (size_t i = begin; i < end; i++)
+      ret->append(this->elements[i]->clone());
+  }
+
+  return ret;
+}
+
+void ObjVector::make_unique()
+{
+  auto& cols = *this->columns;
+
+  // 自分だけが使っていて、範囲も列全体と同じ
+  if (this->columns.use_count() == 1 && this->row_offset == 0 &&
+      (cols.empty() ||
+       cols[0].size() == this->row_count * StructLayout::get_inline_size(
+                                             this->layout->fields[0].kind)))
+    return;
+
+  auto copy = make_heap_shared<Columns, TYPE_Vector>(cols.size());
+
+  for (size_t f = 0; f < cols.size(); f++) {
+    auto view = this->column_view(f);
+
+    (*copy)[f].assign(view.begin(), view.end());
+  }
+
+  this->columns = std::move(copy);
+  this->row_offset = 0;
+}
+
+void ObjVector::permute(std::vector<size_t> const& order)
+{
+  if (!this->is_columnar()) {
+    Elements elems(order.size());
+
+    for (size_t i = 0; i < order.size(); i++)
+      elems[i] = this->elements[order[i]];
+
+    this->elements = std::move(elems);
+    return;
+  }
+
+  auto cols =
+    make_heap_shared<Columns, TYPE_Vector>(this->layout->fields.size());
+
+  for (size_t f = 0; f < cols->size(); f++) {
+    auto size = StructLayout::get_inline_size(this->layout->fields[f].kind);
+    auto& col = (*cols)[f];
+
+    col.resize(order.size() * size);
+
+    for (size_t i = 0; i < order.size(); i++)
+      memcpy(col.data() + i * size, this->column_ptr(order[i], f), size);
+  }
+
+  this->columns = std::move(cols);
+  this->row_offset = 0;
+}
@@ -1,3 +1,4 @@
+#include <map>
 #include <cassert>
 #include <iostream>
 
@@ -5,6 +6,7 @@
 #include "Debug.h"
 
 #include "AST/AST.h"
+#include "Object/Object.h"
 
 static std::vector<std::pair<TypeKind, char const*>> const g_kind_and_names{
   {TYPE_None, "none"},   {TYPE_Int, "int"},
@@ -12,7 +14,11 @@ static std::vector<std::pair<TypeKind, char const*>> const g_kind_and_names{
   {TYPE_Float, "float"}, {TYPE_Bool, "bool"},
   {TYPE_Char, "char"},   {TYPE_String, "string"},
   {TYPE_Range, "range"}, {TYPE_Vector, "vector"},
-  {TYPE_Dict, "dict"},   {TYPE_Args, "args"},
+  {TYPE_Dict, "dict"},   {TYPE_Set, "set"},
+  {TYPE_Deque, "deque"}, {TYPE_Heap, "heap"},
+  {TYPE_Bitset, "bitset"}, {TYPE_NdArray, "ndarray"},
+  {TYPE_PVector, "pvector"}, {TYPE_PDict, "pdict"},
+  {TYPE_Args, "args"},   {TYPE_StringBuilder, "StringBuilder"},
 };
 
 //
@@ -121,4 +127,61 @@ bool TypeInfo::equals(TypeInfo const& type) const
   }
 
   return true;
-}
\ No newline at end of file
+}
+
+//
+// ------------------------------------------------
+//  StructLayout
+// ------------------------------------------------
+size_t StructLayout::get_inline_size(TypeKind kind)
+{
+  switch (kind) {
+    case TYPE_Int:
+      return sizeof(int64_t);
+
+    case TYPE_USize:
+      return sizeof(size_t);
+
+    case TYPE_Float:
+      return sizeof(float);
+
+    case TYPE_Bool:
+      return sizeof(bool);
+
+    case TYPE_Char:
+      return sizeof(metro_char_t);
+  }
+
+  return 0;
+}
+
+StructLayout::StructLayout(std::vector<TypeInfo> const& member_types)
+  : size(0)
+{
+  for (auto&& type : member_types) {
+    auto& field = this->fields.emplace_back();
+
+    auto inline_size = get_inline_size(type.kind);
+
+    field.kind = type.kind;
+    field.is_inline = inline_size != 0;
+
+    auto align = field.is_inline ? inline_size : sizeof(Object*);
+
+    field.offset = (this->size + align - 1) / align * align;
+    this->size = field.offset + (field.is_inline ? inline_size : align);
+  }
+
+  this->size = (this->size + sizeof(Object*) - 1) / sizeof(Object*) *
+               sizeof(Object*);
+}
+
+StructLayout const& StructLayout::get_scalar_layout(TypeKind kind)
+{
+  static std::map<TypeKind, StructLayout> layouts;
+
+  if (auto it = layouts.find(kind); it != layouts.end())
+    return it->second;
+
+  return layouts.emplace(kind, StructLayout({TypeInfo(kind)})).first->second;
+}
@@ -1,21 +1,35 @@
-#include <codecvt>
-#include <locale>
-
 #include "Utils.h"
 #include "Debug.h"
+#include "Kernel.h"
 
-namespace Utils::String {
-
-static std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>, wchar_t> conv;
+// --------------------------------------------------------
+//  metro_string_t
+//
+//  UTF-8 との変換は Kernel で行う
+//  (ASCII の部分はまとめて変換される)
+// --------------------------------------------------------
 
-std::wstring to_wstr(std::string const& str)
+std::string metro_string_t::to_string() const
 {
-  return conv.from_bytes(str);
+  return metro_string_t::to_string(*this);
 }
 
-std::string to_str(std::wstring const& str)
+std::string metro_string_t::to_string(std::u16string_view str)
 {
-  return conv.to_bytes(str);
+  std::string ret;
+
+  ret.resize(str.length() * 3);
+  ret.resize(Kernel::utf16_to_utf8(str.data(), str.length(), ret.data()));
+
+  return ret;
 }
 
-}  // namespace Utils::String
+metro_string_t metro_string_t::from_utf8(std::string_view str)
+{
+  metro_string_t ret;
+
+  ret.resize(str.length());
+  ret.resize(Kernel::utf8_to_utf16(str.data(), str.length(), ret.data()));
+
+  return ret;
+}
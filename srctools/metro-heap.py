@@ -0,0 +1,238 @@
+import sys
+import struct
+from collections import defaultdict
+
+def GetAboutString():
+    return \
+"""
+ヒープのスナップショット解析ツール
+
+metro --heap-dump=<file> または dump_heap(path) で書き出したファイルを読み込み、
+型ごと・確保した位置ごとの保持サイズ (retained size) を表示する
+
+保持サイズは支配木から求める
+参照カウントが参照元の数より多い (変数などから参照されている)
+オブジェクトをルートとみなす
+ルートから辿れないもの (循環参照など) の保持サイズは 0 とする
+
+usage:
+    python3 metro-heap.py [options...] <file>
+
+options:
+    --top=N         上位 N 件のみ表示する (デフォルト 20)
+    --help  -h      このメッセージを表示
+"""
+
+class HeapObject:
+    def __init__(self, addr, kind, size, ref_count, site, refs):
+        self.addr = addr
+        self.kind = kind
+        self.size = size
+        self.ref_count = ref_count
+        self.site = site
+        self.refs = refs
+
+#
+# load()
+#
+# スナップショットを読み込む
+# 型の名前の表 (TypeKind -> 名前) とオブジェクトのリストを返す
+def load(path: str):
+    with open(path, 'rb') as f:
+        data = f.read()
+
+    if data[:8] != b'METROHP2':
+        raise ValueError('not a metro heap dump (or an unsupported version)')
+
+    pos = 8
+
+    def read(fmt):
+        nonlocal pos
+        values = struct.unpack_from('<' + fmt, data, pos)
+        pos += struct.calcsize('<' + fmt)
+        return values
+
+    type_names = { }
+
+    for _ in range(read('I')[0]):
+        kind, length = read('BI')
+        type_names[kind] = data[pos:pos + length].decode('utf-8')
+        pos += length
+
+    sites = [ ]
+
+    for _ in range(read('I')[0]):
+        length = read('I')[0]
+        sites.append(data[pos:pos + length].decode('utf-8'))
+        pos += length
+
+    objects = [ ]
+
+    for _ in range(read('Q')[0]):
+        addr, kind, size, ref_count, site, nrefs = read('QBQQII')
+        refs = list(read(f'{nrefs}Q')) if nrefs else [ ]
+
+        objects.append(HeapObject(addr, kind, size, ref_count,
+            None if site == 0xFFFFFFFF else sites[site], refs))
+
+    return type_names, objects
+
+#
+# compute_retained()
+#
+# 支配木を作り、各オブジェクトの保持サイズを求める
+# (Cooper, Harvey, Kennedy: "A Simple, Fast Dominance Algorithm")
+def compute_retained(objects: list):
+    index = {o.addr: i + 1 for i, o in enumerate(objects)}
+    count = len(objects) + 1  # 0 = 仮想のルート
+
+    succ = [[ ] for _ in range(count)]
+    pred = [[ ] for _ in range(count)]
+    in_degree = [0] * count
+
+    for i, o in enumerate(objects):
+        for r in o.refs:
+            if r in index:
+                succ[i + 1].append(index[r])
+                in_degree[index[r]] += 1
+
+    for i, o in enumerate(objects):
+        if o.ref_count > in_degree[i + 1]:
+            succ[0].append(i + 1)
+
+    for v in range(count):
+        for w in succ[v]:
+            pred[w].append(v)
+
+    # 逆後順
+    order = [ ]
+    visited = [False] * count
+    stack = [(0, 0)]
+    visited[0] = True
+
+    while stack:
+        v, i = stack.pop()
+
+        if i < len(succ[v]):
+            stack.append((v, i + 1))
+            w = succ[v][i]
+
+            if not visited[w]:
+                visited[w] = True
+                stack.append((w, 0))
+        else:
+            order.append(v)
+
+    order.reverse()
+    rpo = {v: i for i, v in enumerate(order)}
+
+    idom = [None] * count
+    idom[0] = 0
+
+    def intersect(a, b):
+        while a != b:
+            while rpo[a] > rpo[b]:
+                a = idom[a]
+            while rpo[b] > rpo[a]:
+                b = idom[b]
+        return a
+
+    changed = True
+
+    while changed:
+        changed = False
+
+        for v in order[1:]:
+            new_idom = None
+
+            for p in pred[v]:
+                if idom[p] is None:
+                    continue
+
+                new_idom = p if new_idom is None else intersect(p, new_idom)
+
+            if idom[v] != new_idom:
+                idom[v] = new_idom
+                changed = True
+
+    retained = [0] * count
+
+    for i, o in enumerate(objects):
+        retained[i + 1] = o.size
+
+    # 子から親へ足していく
+    for v in reversed(order[1:]):
+        retained[idom[v]] += retained[v]
+
+    return idom, retained
+
+#
+# summarize()
+#
+# key ごとに集計する
+# 同じ key のオブジェクトに支配されているものは、保持サイズを二重に数えない
+def summarize(objects: list, idom: list, retained: list, key):
+    result = defaultdict(lambda: [0, 0, 0])  # count, shallow, retained
+
+    for i, o in enumerate(objects):
+        k = key(o)
+        entry = result[k]
+
+        entry[0] += 1
+        entry[1] += o.size
+
+        d = idom[i + 1]
+
+        # ルートから辿れない
+        if d is None:
+            continue
+
+        while d not in (0, None) and key(objects[d - 1]) != k:
+            d = idom[d]
+
+        if d == 0:
+            entry[2] += retained[i + 1]
+
+    return result
+
+def print_table(title: str, table: dict, top: int):
+    print(f'\n{title}:')
+    print(f'  {"retained":>12} {"shallow":>12} {"count":>10}  name')
+
+    rows = sorted(table.items(), key=lambda kv: kv[1][2], reverse=True)
+
+    for name, (count, shallow, retained) in rows[:top]:
+        print(f'  {retained:>12} {shallow:>12} {count:>10}  {name}')
+
+def main():
+    top = 20
+    path = None
+
+    for arg in sys.argv[1:]:
+        if arg in ('--help', '-h'):
+            print(GetAboutString())
+            return 0
+        elif arg.startswith('--top='):
+            top = int(arg[6:])
+        else:
+            path = arg
+
+    if path is None:
+        print(GetAboutString())
+        return 1
+
+    type_names, objects = load(path)
+    idom, retained = compute_retained(objects)
+
+    print(f'{len(objects)} objects, {sum(o.size for o in objects)} bytes')
+
+    print_table('by type', summarize(objects, idom, retained,
+        lambda o: type_names.get(o.kind, str(o.kind))), top)
+
+    print_table('by allocation site', summarize(objects, idom, retained,
+        lambda o: o.site or '<unknown>'), top)
+
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
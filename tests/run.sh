@@ -0,0 +1,21 @@
+#!/bin/sh
+#
+# tests/test-*.sh をすべて実行する
+#
+# usage: tests/run.sh [metro のパス]
+
+METRO=${1:-./metro}
+export METRO
+
+failed=0
+
+for t in "$(dirname "$0")"/test-*.sh; do
+  if sh "$t"; then
+    echo "ok   $(basename "$t")"
+  else
+    echo "FAIL $(basename "$t")"
+    failed=1
+  fi
+done
+
+exit $failed
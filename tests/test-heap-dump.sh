@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# --max-heap で中止したときも --heap-dump が書き出される
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+cat > "$tmp/grow.metro" <<'END'
+let v = [0];
+for i in 0..2000000 { v.push(i); }
+END
+
+# 上限を超えて中止する
+if "$METRO" --max-heap=1M --heap-dump="$tmp/limit.bin" "$tmp/grow.metro" \
+     2> /dev/null; then
+  echo "expected heap limit error"
+  exit 1
+fi
+
+[ -s "$tmp/limit.bin" ] || { echo "no dump on heap limit"; exit 1; }
+
+# exit() で終了する
+printf 'let v = [1, 2];\nexit(3);\n' > "$tmp/exit.metro"
+
+"$METRO" --heap-dump="$tmp/exit.bin" "$tmp/exit.metro"
+[ $? -eq 3 ] || { echo "unexpected exit code"; exit 1; }
+
+[ -s "$tmp/exit.bin" ] || { echo "no dump on exit()"; exit 1; }
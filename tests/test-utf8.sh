@@ -0,0 +1,35 @@
+#!/bin/sh
+#
+# open() で読んだ不正な UTF-8 は、最長の不正な部分列ごとに U+FFFD になる
+
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+
+# check <入力のバイト列> <期待する出力のバイト列>
+check() {
+  printf "$1" > "$tmp/in.txt"
+  printf 'print(open("%s"));\n' "$tmp/in.txt" > "$tmp/read.metro"
+
+  got=$("$METRO" "$tmp/read.metro" | od -An -tx1 | tr -d ' \n')
+  want=$(printf "$2" | od -An -tx1 | tr -d ' \n')
+
+  [ "$got" = "$want" ] || { echo "input '$1': got $got, want $want"; exit 1; }
+}
+
+R='\357\277\275'  # U+FFFD
+
+# 途中で切れた 3 バイトの並び (E3 81)
+check 'a\343\201b\n' "a${R}b\n"
+check '\343\201' "${R}\n"
+
+# 途中で切れた 4 バイトの並び (F0 9F 98)
+check 'a\360\237\230b\n' "a${R}b\n"
+check '\360\237\230\360\237\230\200\n' "${R}\360\237\230\200\n"
+
+# 冗長な表現とサロゲートは 1 バイトずつ
+check '\300\200\n' "${R}${R}\n"
+check '\340\200\200\n' "${R}${R}${R}\n"
+check '\355\240\200\n' "${R}${R}${R}\n"
+
+# U+10FFFF を超える
+check '\364\220\200\200\n' "${R}${R}${R}${R}\n"